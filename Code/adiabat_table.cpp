@@ -0,0 +1,401 @@
+// 
+// adiabat_table.cpp
+// Precomputed lookup surface of driver output. The ascent branch of
+// parcel_motion_driver() is tabulated over a grid of starting
+// pressure, temperature and vapor mixing ratio, and saved to a file
+// that is memory mapped for queries. A query is a 4D multilinear
+// interpolation, in the three inputs plus the level, so operational
+// "state at pressure p" questions never touch the solver.
+//
+// The level axis is distance ascended, level k sits at pMB0 - k*dpMB,
+// so every starting pressure shares it. 'n_levels' is set by the
+// lowest starting pressure, higher starts are cut off at that many
+// levels.
+//
+// Tabulated variables (AT_N_VARS per node, interleaved):
+//    theta (K), T (K), qv (g/kg), qc (g/kg)
+//
+// The build finishes by checking interpolated values at random points
+// against the real solver, and the worst and RMS errors per variable
+// are stored in the header.
+//
+// The header also records the saturation phase (sat_phase) the table
+// was built with, and a table is only opened by runs using the same
+// one. Tables from before the phase was recorded are refused.
+//
+// Requires: parcel_structs.cpp, parcel_motion_driver.cpp
+//
+// ver. 1.1
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - Saturation phase kept in the header and checked
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <stdint.h>
+   #include <fcntl.h>
+   #include <unistd.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <vector>
+   #include <thread>
+   #include <atomic>
+
+   #define AT_MAGIC   0x32544150  // "PAT2"
+   #define AT_N_VARS  4           // theta, T, qv, qc
+   #define AT_N_AXES  3           // pMB0, TC, qv
+
+   struct at_axis {
+      double lo;
+      double hi;
+      uint32_t n;     // no. of nodes, >= 2
+      uint32_t pad;
+   };
+
+   struct at_header {
+      uint32_t magic;
+      uint32_t n_vars;
+      at_axis axis[AT_N_AXES];
+      double dpMB;               // level spacing (mb)
+      uint32_t n_levels;
+      uint32_t n_samples;        // validation points
+      uint32_t sat_phase;        // SAT_PHASE_LIQUID or SAT_PHASE_MIXED
+      uint32_t pad;
+      double max_err[AT_N_VARS]; // worst |table - solver|
+      double rms_err[AT_N_VARS];
+   };
+
+   struct adiabat_table {
+      at_header* hdr;
+      const double* data;
+      size_t map_bytes;
+   };
+
+
+// Reads an axis given as "lo:hi:n". Returns 0 on success.
+   int at_parse_axis(const char* s, at_axis* A){
+      unsigned n;
+      if ( sscanf(s, "%lf:%lf:%u", &A->lo, &A->hi, &n) != 3 ){ return 1; }
+      A->n = n;
+      A->pad = 0;
+      return 0;
+   }
+
+// Node value along an axis
+   double at_node(const at_axis& A, int i){
+      return A.lo + (A.hi - A.lo) * i / (A.n - 1);
+   }
+
+// Offset of the first variable at (ip, it, iq, level)
+   size_t at_offset(const at_header* H, int ip, int it, int iq, int k){
+      size_t n = ((size_t)ip * H->axis[1].n + it) * H->axis[2].n + iq;
+      return (n * H->n_levels + k) * AT_N_VARS;
+   }
+
+
+// --------------------------------------------------------------------
+// Query. Fills 'out' with theta, T, qv, qc at pressure 'p_mb' for a
+// parcel started at (pMB0, TC, qv). Returns 0 inside the table, 1 if
+// any coordinate had to be clamped to the edge.
+// --------------------------------------------------------------------
+
+   int at_query(const adiabat_table* tab, double pMB0, double TC, 
+                double qv, double p_mb, double out[AT_N_VARS]){
+
+      const at_header* H = tab->hdr;
+      double x[AT_N_AXES + 1] = { pMB0, TC, qv, 0 };
+      
+      int i0[AT_N_AXES + 1];
+      double w[AT_N_AXES + 1];
+      int clamped = 0;
+
+// Cell and weight along each input axis
+      for (int a=0; a < AT_N_AXES; a++){
+         const at_axis& A = H->axis[a];
+         double f = (x[a] - A.lo) / (A.hi - A.lo) * (A.n - 1);
+         
+         if ( f < 0 ){ f = 0; clamped = 1; }
+         if ( f > A.n - 1 ){ f = A.n - 1; clamped = 1; }
+         
+         i0[a] = (int)f;
+         if ( i0[a] > (int)A.n - 2 ){ i0[a] = A.n - 2; }
+         w[a] = f - i0[a];
+      }
+      
+// ... and along the level axis
+      double f = (pMB0 - p_mb) / H->dpMB;
+      if ( f < 0 ){ f = 0; clamped = 1; }
+      if ( f > H->n_levels - 1 ){ f = H->n_levels - 1; clamped = 1; }
+      
+      i0[3] = (int)f;
+      if ( i0[3] > (int)H->n_levels - 2 ){ i0[3] = H->n_levels - 2; }
+      w[3] = f - i0[3];
+
+      for (int v=0; v < AT_N_VARS; v++){ out[v] = 0; }
+
+// Sum over the 16 corners of the 4D cell
+      for (int c=0; c < 16; c++){
+      
+         double wc = 1;
+         int ix[4];
+         
+         for (int a=0; a < 4; a++){
+            int bit = (c >> a) & 1;
+            ix[a] = i0[a] + bit;
+            wc *= bit ? w[a] : 1 - w[a];
+         }
+         
+         if ( wc == 0 ){ continue; }
+         
+         const double* node = tab->data + at_offset(H,ix[0],ix[1],ix[2],ix[3]);
+         for (int v=0; v < AT_N_VARS; v++){ out[v] += wc * node[v]; }
+      }
+      
+      return clamped;
+      
+   } // End at_query
+
+
+// --------------------------------------------------------------------
+// One solver column, in table units. The driver keeps the raw kg/kg
+// inputs at level 0 and g/kg above, so level 0 is rescaled here.
+// --------------------------------------------------------------------
+
+   void at_solve_column(double pMB0, double TC, double qv, double dpMB,
+                        double ptopMB, int n_levels, double* dst){
+
+      packaged_computations* AB = new packaged_computations;
+      
+      *AB = parcel_motion_driver(pMB0, TC, qv, 0.0, qv, 0.0, 0.5, 
+                                 dpMB, ptopMB, 0);
+                                 
+      for (int k=0; k < n_levels; k++){
+         double scale = k == 0 ? 1.e3 : 1.0;
+         dst[k*AT_N_VARS + 0] = AB->theta_K[k];
+         dst[k*AT_N_VARS + 1] = AB->T_K[k];
+         dst[k*AT_N_VARS + 2] = AB->qv_gkg[k] * scale;
+         dst[k*AT_N_VARS + 3] = AB->qc_gkg[k] * scale;
+      }
+      
+      delete AB;
+      
+   } // End at_solve_column
+
+
+// --------------------------------------------------------------------
+// Build the table at 'path'. Columns are independent, so they are
+// handed out to 'n_threads' workers one at a time.
+// Returns 0 on success.
+// --------------------------------------------------------------------
+
+   int at_build(const char* path, const at_axis axes[AT_N_AXES],
+                double dpMB, double ptopMB, int n_samples, int n_threads){
+
+      at_header H;
+      memset(&H, 0, sizeof(H));
+      H.magic = AT_MAGIC;
+      H.n_vars = AT_N_VARS;
+      H.dpMB = dpMB;
+      H.sat_phase = sat_phase;
+      
+      for (int a=0; a < AT_N_AXES; a++){
+         H.axis[a] = axes[a];
+         if ( H.axis[a].n < 2 || !(H.axis[a].hi > H.axis[a].lo) ){
+            printf("Table axis %d needs lo < hi and at least 2 nodes\n", a);
+            return 1;
+         }
+      }
+      
+      int n_cycles = (H.axis[0].lo - ptopMB) / dpMB;
+      int n_steps = (2 * n_cycles) + 1;
+      
+      if ( n_cycles < 1 || n_steps > cmax ){
+         printf("Table pressure range must give 1 to %d levels\n", cmax/2);
+         return 1;
+      }
+      H.n_levels = n_cycles + 1;
+      
+// The highest start must also fit the driver's arrays.
+      if ( 2 * (int)((H.axis[0].hi - ptopMB) / dpMB) + 1 > cmax ){
+         printf("Table starting pressures exceed cmax levels\n");
+         return 1;
+      }
+
+      size_t n_cols = (size_t)H.axis[0].n * H.axis[1].n * H.axis[2].n;
+      size_t col_len = (size_t)H.n_levels * AT_N_VARS;
+      
+      std::vector<double> data(n_cols * col_len);
+      std::atomic<size_t> next(0);
+
+      auto worker = [&](){
+         size_t c;
+         while ( (c = next++) < n_cols ){
+            int iq = c % H.axis[2].n;
+            int it = (c / H.axis[2].n) % H.axis[1].n;
+            int ip = c / ((size_t)H.axis[2].n * H.axis[1].n);
+            
+            at_solve_column(at_node(H.axis[0],ip), at_node(H.axis[1],it),
+                            at_node(H.axis[2],iq), dpMB, ptopMB,
+                            H.n_levels, &data[c * col_len]);
+         }
+      };
+
+      if ( n_threads < 1 ){ n_threads = 1; }
+      std::vector<std::thread> pool;
+      for (int t=0; t < n_threads; t++){ pool.push_back(std::thread(worker)); }
+      for (int t=0; t < n_threads; t++){ pool[t].join(); }
+
+// Validate against the solver at random points inside the domain.
+      adiabat_table tab;
+      tab.hdr = &H;
+      tab.data = &data[0];
+      
+      std::vector<double> col(col_len);
+      double sum2[AT_N_VARS] = {0, 0, 0, 0};
+      
+      for (int s=0; s < n_samples; s++){
+      
+         double x[AT_N_AXES];
+         for (int a=0; a < AT_N_AXES; a++){
+            x[a] = H.axis[a].lo + (H.axis[a].hi - H.axis[a].lo) * 
+                   (random() * (1.0/RAND_MAX));
+         }
+         
+         at_solve_column(x[0], x[1], x[2], dpMB, ptopMB, H.n_levels, &col[0]);
+         
+         for (int k=0; k < (int)H.n_levels; k++){
+            double out[AT_N_VARS];
+            at_query(&tab, x[0], x[1], x[2], x[0] - k*dpMB, out);
+            
+            for (int v=0; v < AT_N_VARS; v++){
+               double e = fabs(out[v] - col[k*AT_N_VARS + v]);
+               if ( e > H.max_err[v] ){ H.max_err[v] = e; }
+               sum2[v] += e*e;
+            }
+         }
+      }
+      
+      H.n_samples = n_samples;
+      for (int v=0; v < AT_N_VARS; v++){
+         H.rms_err[v] = n_samples > 0 ? 
+            sqrt(sum2[v] / ((double)n_samples * H.n_levels)) : 0;
+      }
+
+// Write it out
+      FILE* fp = fopen(path, "wb");
+      if ( fp == NULL ){
+         perror(path);
+         return 1;
+      }
+      
+      bool ok = fwrite(&H, sizeof(H), 1, fp) == 1 &&
+                fwrite(&data[0], sizeof(double), data.size(), fp) == data.size();
+      ok = (fclose(fp) == 0) && ok;
+      
+      if ( !ok ){
+         perror(path);
+         return 1;
+      }
+      
+      return 0;
+      
+   } // End at_build
+
+
+// --------------------------------------------------------------------
+// Open / close
+// --------------------------------------------------------------------
+
+   adiabat_table* at_open(const char* path){
+
+      int fd = open(path, O_RDONLY);
+      if ( fd < 0 ){
+         perror(path);
+         return NULL;
+      }
+      
+      struct stat st;
+      if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(at_header) ){
+         close(fd);
+         return NULL;
+      }
+      
+      void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      
+      if ( map == MAP_FAILED ){
+         perror(path);
+         return NULL;
+      }
+      
+      at_header* H = (at_header*)map;
+      size_t n = (size_t)H->axis[0].n * H->axis[1].n * H->axis[2].n * 
+                 H->n_levels * AT_N_VARS;
+                 
+      if ( H->magic != AT_MAGIC || H->n_vars != AT_N_VARS ||
+           (size_t)st.st_size != sizeof(at_header) + n*sizeof(double) ){
+         printf("%s is not a usable adiabat table\n", path);
+         munmap(map, st.st_size);
+         return NULL;
+      }
+
+// Values from the other adjustment would be off by the ice latent
+// heat, without any sign of it in the output.
+      if ( H->sat_phase != (uint32_t)sat_phase ){
+         printf("%s was built %s, this run is %s\n", path,
+                H->sat_phase == SAT_PHASE_MIXED ? "with --ice" : "liquid only",
+                sat_phase == SAT_PHASE_MIXED ? "with --ice" : "liquid only");
+         munmap(map, st.st_size);
+         return NULL;
+      }
+      
+      adiabat_table* tab = new adiabat_table;
+      tab->hdr = H;
+      tab->data = (const double*)((char*)map + sizeof(at_header));
+      tab->map_bytes = st.st_size;
+      
+      return tab;
+      
+   } // End at_open
+
+
+   void at_close(adiabat_table* tab){
+
+      if ( tab == NULL ){ return; }
+      
+      munmap(tab->hdr, tab->map_bytes);
+      delete tab;
+      
+   } // End at_close
+
+
+// Summary of a table, including the solver comparison.
+   void at_print_info(const adiabat_table* tab){
+
+      const at_header* H = tab->hdr;
+      const char* axes[] = { "pMB0", "TC", "qv" };
+      const char* vars[] = { "theta", "T", "qv", "qc" };
+      
+      for (int a=0; a < AT_N_AXES; a++){
+         printf("> %-5s %g to %g, %u nodes\n", axes[a], 
+                H->axis[a].lo, H->axis[a].hi, H->axis[a].n);
+      }
+      printf("> %u levels every %g mb, %s\n", H->n_levels, H->dpMB,
+             H->sat_phase == SAT_PHASE_MIXED ? "mixed phase" : "liquid only");
+      
+      printf("> Error vs solver over %u random columns:\n", H->n_samples);
+      for (int v=0; v < AT_N_VARS; v++){
+         printf(">    %-5s max %.3e  rms %.3e\n", vars[v], 
+                H->max_err[v], H->rms_err[v]);
+      }
+      
+   } // All done!
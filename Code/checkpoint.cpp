@@ -0,0 +1,160 @@
+// 
+// checkpoint.cpp
+// Checkpoint and resume for long ensemble runs. A checkpoint records
+// how many trials are finished, how many draws have been taken from
+// random() and how long the results file was at that moment. Resuming
+// cuts the results file back to that length, replays the draws and
+// carries on, so the final output matches an uninterrupted run.
+//
+// Checkpoints are written to '<path>.tmp', fsync'd and renamed over
+// '<path>', then the directory is fsync'd. A crash at any point leaves
+// either the old checkpoint or the new one, never a torn file.
+//
+// Sharded runs always keep a checkpoint, 'p_model_merge' reads it to
+// tell a finished shard from one that was cut short, and whether the
+// shard wrote CAPE/CIN to 'cape.txt'.
+//
+// ver. 1.2
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - No longer needs result_cache.cpp, so the merge
+//                    tool can read checkpoints
+// October 19, 2026 - Records whether the run wrote CAPE output
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <errno.h>
+   #include <stdint.h>
+   #include <fcntl.h>
+   #include <unistd.h>
+   #include <libgen.h>
+   #include <sys/stat.h>
+
+   #define CKPT_VERSION 2
+
+   struct run_checkpoint {
+      long n_trials;       // trials requested for the whole run
+      long trials_done;    // trials [0, trials_done) are complete
+      long rng_draws;      // calls made to random() so far
+      long output_bytes;   // durable length of the results file
+      uint64_t params;     // fingerprint of the run parameters
+      int cape_output;     // wrote 'cape.txt' too? (--sounding)
+   };
+
+
+// --------------------------------------------------------------------
+// Fingerprint of everything that changes the output, so we refuse to
+// resume a run with different parameters.
+// --------------------------------------------------------------------
+
+   uint64_t ckpt_fingerprint(const double* params, int n){
+
+// FNV-1a, the same hash as rc_fnv1a()
+      const unsigned char* p = (const unsigned char*)params;
+      uint64_t h = 14695981039346656037ULL;
+      
+      for (size_t i=0; i < n * sizeof(double); i++){
+         h ^= p[i];
+         h *= 1099511628211ULL;
+      }
+      
+      return h;
+      
+   } // End ckpt_fingerprint
+
+
+// Flushes 'f' to disk and returns its length, or -1. A missing file
+// has length 0.
+   long ckpt_sync_output(const std::string& f){
+
+      int fd = open(f.c_str(), O_WRONLY);
+      
+      if ( fd < 0 ){ return errno == ENOENT ? 0 : -1; }
+      
+      struct stat st;
+      long bytes = -1;
+      
+      if ( fsync(fd) == 0 && fstat(fd, &st) == 0 ){ bytes = st.st_size; }
+      
+      close(fd);
+      
+      return bytes;
+      
+   } // End ckpt_sync_output
+
+
+// --------------------------------------------------------------------
+// Atomic write. Returns 0 on success.
+// --------------------------------------------------------------------
+
+   int ckpt_write(const char* path, const run_checkpoint& C){
+
+      std::string tmp = std::string(path) + ".tmp";
+      
+      FILE* fp = fopen(tmp.c_str(), "w");
+      if ( fp == NULL ){
+         perror(tmp.c_str());
+         return -1;
+      }
+      
+      fprintf(fp, "parcel_model checkpoint %d\n", CKPT_VERSION);
+      fprintf(fp, "n_trials %ld\n", C.n_trials);
+      fprintf(fp, "trials_done %ld\n", C.trials_done);
+      fprintf(fp, "rng_draws %ld\n", C.rng_draws);
+      fprintf(fp, "output_bytes %ld\n", C.output_bytes);
+      fprintf(fp, "params %016llx\n", (unsigned long long)C.params);
+      fprintf(fp, "cape_output %d\n", C.cape_output);
+      
+      int ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+      ok = (fclose(fp) == 0) && ok;
+      
+      if ( !ok || rename(tmp.c_str(), path) != 0 ){
+         perror(path);
+         return -1;
+      }
+
+// The rename is only durable once the directory entry is on disk.
+      std::string dir_buf = path;
+      int dfd = open(dirname(&dir_buf[0]), O_RDONLY);
+      if ( dfd >= 0 ){
+         fsync(dfd);
+         close(dfd);
+      }
+      
+      return 0;
+      
+   } // End ckpt_write
+
+
+// Returns 0 and fills 'C' if 'path' holds a checkpoint we understand.
+   int ckpt_read(const char* path, run_checkpoint* C){
+
+      FILE* fp = fopen(path, "r");
+      if ( fp == NULL ){ return -1; }
+      
+      int version = 0;
+      unsigned long long params = 0;
+      
+      int n = fscanf(fp, "parcel_model checkpoint %d n_trials %ld "
+                     "trials_done %ld rng_draws %ld output_bytes %ld "
+                     "params %llx cape_output %d", &version, &C->n_trials, 
+                     &C->trials_done, &C->rng_draws, &C->output_bytes,
+                     &params, &C->cape_output);
+      fclose(fp);
+      
+      C->params = params;
+      
+      if ( n != 7 || version != CKPT_VERSION ){ return -1; }
+      
+      return 0;
+      
+   } // All done!
@@ -6,10 +6,11 @@
 // 
 // Returns: alpha
 //
-// ver. 1.0
+// ver. 1.1
 // 
 // -- Change log --
 // April 23, 2015 - Initial Release
+// October 19, 2026 - Templated on the scalar type, see dual_number.cpp
 //
 // -- Licence --
 // Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
@@ -21,18 +22,19 @@
 //
 // --------------------------------------------------------------------
    
-   double compute_alpha(double pbar, double pibar, double tstar){
+   template <typename real>
+   real compute_alpha(real pbar, real pibar, real tstar){
 
 // Break into parts to solve   
-      double A = compute_des_dt_pa(tstar);
+      real A = compute_des_dt_pa(tstar);
       double B = 0.622;
-      double C = pibar * pbar;
+      real C = pibar * pbar;
    
-      double DA = pbar - compute_esat_pa(tstar);
-      double D = DA * DA;
+      real DA = pbar - compute_esat_pa(tstar);
+      real D = DA * DA;
    
 // Put the parts together
-      double alpha = A * B * C / D;                    
+      real alpha = A * B * C / D;                    
      
       return alpha;
    
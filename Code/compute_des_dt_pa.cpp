@@ -8,10 +8,11 @@
 // Returns: desdT_Pa or the saturation water vapor pressure over 
 // water in Pa
 // 
-// ver. 1.0
+// ver. 1.1
 // 
 // -- Change log --
 // April 23, 2015 - Initial Release
+// October 19, 2026 - Templated on the scalar type, see dual_number.cpp
 //
 // -- Licence --
 // Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
@@ -23,7 +24,8 @@
 //
 // --------------------------------------------------------------------
 
-   double compute_des_dt_pa(double T){
+   template <typename real>
+   real compute_des_dt_pa(real T){
 
 // 'L' is the latent heat of vaporization at 0 degrees C in J/kg,
 // and 'Rv' is the gas constant for water vapor in J/(kg*K)
@@ -31,8 +33,8 @@
       double Rv = 461.5;
 
 
-      double AA; // this is a working variable for 'des/dT'
-      double BB = compute_esat_pa(T);
+      real AA; // this is a working variable for 'des/dT'
+      real BB = compute_esat_pa(T);
    
       AA = (L/Rv) * ( BB / (T*T) );
 
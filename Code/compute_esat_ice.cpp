@@ -0,0 +1,241 @@
+//
+// compute_esat_ice.cpp
+// Saturation over ice and mixed-phase saturation for satadjust.cpp,
+// used when the model runs with '--ice' (sat_phase = SAT_PHASE_MIXED).
+//
+// Between T_ice (-23 C) and the triple point the condensate is shared
+// between liquid and ice with the liquid fraction
+//    w(T) = ((T - T_ice) / (T_0 - T_ice))^2
+// (w = 1 above T_0, 0 below T_ice). Saturation and latent heat are
+// weighted the same way:
+//    e_s   = w e_s,liq + (1-w) e_s,ice
+//    L     = w L_v + (1-w) L_s
+// e_s,liq is compute_esat_pa, e_s,ice is the Goff-Gratch formula over
+// ice, and both derivatives use Clausius-Clapeyron as compute_des_dt_pa
+// does.
+//
+// e_s and de_s/dT are not evaluated from the formulas inside the
+// adjustment. They come from one table, built at startup and shared
+// by every thread, of e_s and de_s/dT and their slopes every 0.1 K
+// from 150 to 330 K, interpolated with cubic Hermite polynomials
+// (relative error about 1e-9 against the formulas).
+// That keeps a mixed-phase step as cheap as a liquid one down to
+// ptop = 100 mb.
+//
+// Requires: T, Temperature in Kelvin
+// Returns:  e_sat and de_sat/dT over liquid/ice in Pascals (Pa/K)
+//
+// ver. 1.0
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   enum sat_phase_mode {
+      SAT_PHASE_LIQUID = 0,   // saturation over water only
+      SAT_PHASE_MIXED  = 1    // liquid, mixed-phase and ice
+   };
+
+// Set once by main() before any run starts.
+   int sat_phase = SAT_PHASE_LIQUID;
+
+   const double es_T0 = 273.16;      // triple point (K)
+   const double es_Tice = 250.16;    // all ice below (K)
+   const double es_Lv = 2.5e6;       // latent heat of vaporization
+   const double es_Ls = 2.834e6;     // latent heat of sublimation
+   const double es_Rv = 461.5;       // gas constant for water vapor
+
+   #define ES_TAB_LO 150.16          // first node (K), nodes fall on
+   #define ES_TAB_DT 0.1             // T_ice and T_0
+   #define ES_TAB_N  1801
+
+
+// Liquid fraction of the condensate
+   template <typename real>
+   real sat_liquid_fraction(real T){
+      if ( T >= es_T0 ){ return real(1.0); }
+      if ( T <= es_Tice ){ return real(0.0); }
+      real x = (T - es_Tice) / (es_T0 - es_Tice);
+      return x * x;
+   }
+
+   template <typename real>
+   real compute_latent_mixed(real T){
+      real w = sat_liquid_fraction(T);
+      return w * es_Lv + (1.0 - w) * es_Ls;
+   }
+
+// Goff-Gratch over ice, Pa
+   double compute_esat_ice_pa(double T){
+      double r = es_T0 / T;
+      return 100 * pow(10, -9.09718 * (r - 1) - 3.56654 * log10(r) +
+                           0.876793 * (1 - 1/r) + log10(6.1071));
+   }
+
+
+// --------------------------------------------------------------------
+// Table
+// --------------------------------------------------------------------
+
+// Exact mixed e_s and de_s/dT, only used to fill the table.
+   void es_mixed_exact(double T, double* e, double* dedT){
+
+      double el = compute_esat_pa(T);
+      double ei = compute_esat_ice_pa(T);
+      double w = sat_liquid_fraction(T);
+
+      double dw = 0;
+      if ( T > es_Tice && T < es_T0 ){
+         dw = 2 * (T - es_Tice) / ((es_T0 - es_Tice) * (es_T0 - es_Tice));
+      }
+
+      *e = w * el + (1 - w) * ei;
+      *dedT = w * (es_Lv / es_Rv) * el / (T*T) +
+              (1 - w) * (es_Ls / es_Rv) * ei / (T*T) + dw * (el - ei);
+
+   } // End es_mixed_exact
+
+
+// Each node holds e_s and de_s/dT with their slopes in T, once for
+// the segment above the node and once for the one below, for the
+// Hermite interpolation. de_s/dT is the Clausius-Clapeyron form above,
+// not the slope of e_s, so both need their own slopes. The two sides
+// differ only at T_ice and T_0, where w(T) has a kink (and de_s/dT a
+// small step).
+   #define ES_UP     0   // e_s, slope, de_s/dT, slope above the node
+   #define ES_DOWN   4   // the same below it
+
+   struct es_table {
+      double node[ES_TAB_N][8];
+   };
+
+   es_table es_table_build(){
+   
+      es_table tab;
+      const double dT = 1.e-4;    // step for the slopes
+      const double eps = 1.e-9;   // just off the node, to pick a side
+      
+      for (int k=0; k < ES_TAB_N; k++){
+      
+         double T = ES_TAB_LO + k * ES_TAB_DT;
+         
+         for (int side=0; side < 2; side++){
+         
+            double s = side == 0 ? 1 : -1;
+            double e[3], de[3];   // at T + s (eps + j dT)
+            
+            for (int j=0; j < 3; j++){
+               es_mixed_exact(T + s*(eps + j*dT), &e[j], &de[j]);
+            }
+            
+// One sided, second order
+            double* n = &tab.node[k][side == 0 ? ES_UP : ES_DOWN];
+            n[0] = e[0];
+            n[1] = s * (-3*e[0] + 4*e[1] - e[2]) / (2*dT);
+            n[2] = de[0];
+            n[3] = s * (-3*de[0] + 4*de[1] - de[2]) / (2*dT);
+         }
+      }
+      
+      return tab;
+   }
+
+   const es_table es_mixed_table = es_table_build();
+
+
+// Cubic Hermite for e_s (c = 0) or de_s/dT (c = 2) on segment k at
+// 0 <= t <= 1. 'slope' gets the derivative in T, if asked for.
+   inline double es_hermite(int k, int c, double t, double* slope){
+   
+      const double h = ES_TAB_DT;
+      double y0 = es_mixed_table.node[k][ES_UP + c];
+      double m0 = es_mixed_table.node[k][ES_UP + c+1] * h;
+      double y1 = es_mixed_table.node[k+1][ES_DOWN + c];
+      double m1 = es_mixed_table.node[k+1][ES_DOWN + c+1] * h;
+
+      double t2 = t * t;
+      double t3 = t2 * t;
+
+      if ( slope != NULL ){
+         *slope = ((6*t2 - 6*t) * (y0 - y1) + (3*t2 - 4*t + 1) * m0 +
+                   (3*t2 - 2*t) * m1) / h;
+      }
+      
+      return (2*t3 - 3*t2 + 1) * y0 + (t3 - 2*t2 + t) * m0 +
+             (3*t2 - 2*t3) * y1 + (t3 - t2) * m1;
+   }
+
+// e_s and de_s/dT at T, and their slopes where the pointers aren't
+// NULL. Outside the table the end segments are extended.
+   inline void es_table_eval(double T, double* e, double* e_slope, 
+                             double* de, double* de_slope){
+
+      double x = (T - ES_TAB_LO) * (1.0 / ES_TAB_DT);
+      int k = (int)x;
+      if ( x < 0 ){ k = 0; }
+      if ( k > ES_TAB_N - 2 ){ k = ES_TAB_N - 2; }
+      double t = x - k;
+
+      *e = es_hermite(k, 0, t, e_slope);
+      *de = es_hermite(k, 2, t, de_slope);
+
+   } // End es_table_eval
+
+
+// --------------------------------------------------------------------
+// Table lookups for satadjust. The dual versions carry the derivative
+// along, see dual_number.cpp.
+// --------------------------------------------------------------------
+
+   inline double compute_esat_mixed_pa(double T){
+      double e, de;
+      es_table_eval(T, &e, NULL, &de, NULL);
+      return e;
+   }
+
+   inline double compute_des_dt_mixed_pa(double T){
+      double e, de;
+      es_table_eval(T, &e, NULL, &de, NULL);
+      return de;
+   }
+
+   inline dual compute_esat_mixed_pa(const dual& T){
+      double e, e_slope, de;
+      es_table_eval(T.v, &e, &e_slope, &de, NULL);
+      dual r(e);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = e_slope * T.d[k]; }
+      return r;
+   }
+
+   inline dual compute_des_dt_mixed_pa(const dual& T){
+      double e, de, de_slope;
+      es_table_eval(T.v, &e, NULL, &de, &de_slope);
+      dual r(de);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = de_slope * T.d[k]; }
+      return r;
+   }
+
+
+// Same as compute_alpha, over the mixed-phase surface
+   template <typename real>
+   real compute_alpha_mixed(real pbar, real pibar, real tstar){
+
+      real A = compute_des_dt_mixed_pa(tstar);
+      double B = 0.622;
+      real C = pibar * pbar;
+
+      real DA = pbar - compute_esat_mixed_pa(tstar);
+      real D = DA * DA;
+
+      return A * B * C / D;
+
+   } // All done!
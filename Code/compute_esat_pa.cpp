@@ -8,10 +8,11 @@
 // Returns:  e_sat, saturation water vapor pressure 
 //                  over water in Pascals
 //
-// ver. 1.0
+// ver. 1.1
 // 
 // -- Change log --
 // April 23, 2015 - Initial Release
+// October 19, 2026 - Templated on the scalar type, see dual_number.cpp
 //
 // -- Licence --
 // Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
@@ -23,28 +24,29 @@
 //
 // --------------------------------------------------------------------
 
-   double compute_esat_pa(double T){
+   template <typename real>
+   real compute_esat_pa(real T){
 
 // Break apart the equation and compute each part.
       double AA = 23.832241;
       double AB = 5.02808;
-      double AC = log10(T);
+      real AC = log10(T);
       double AD = 1.3816e-7;
 
       double BA = 11.344;
-      double BB = 0.0303998 * T;
-      double B = pow(10,(BA-BB));
+      real BB = 0.0303998 * T;
+      real B = pow(10,(BA-BB));
 
       double C = 8.1328e-3;
 
       double DA = 3.49149;
-      double DB = 1302.8844 / T;
-      double D = pow(10,(DA - DB));  
+      real DB = 1302.8844 / T;
+      real D = pow(10,(DA - DB));  
 
-      double E = 2949.076/T;
+      real E = 2949.076/T;
 
 // Put all the parts together    
-      double EQN = 100 * pow(10, (AA-AB*AC-AD*B+C*D-E) );
+      real EQN = 100 * pow(10, (AA-AB*AC-AD*B+C*D-E) );
 
       return EQN;
 
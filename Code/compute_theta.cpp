@@ -8,10 +8,11 @@
 // 
 // Returns:  theta, potential temperature in 
 //
-// ver. 1.0
+// ver. 1.1
 // 
 // -- Change log --
 // April 23, 2015 - Initial Release
+// October 19, 2026 - Templated on the scalar type, see dual_number.cpp
 //
 // -- Licence --
 // Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
@@ -23,9 +24,10 @@
 //
 // --------------------------------------------------------------------
   
-   double compute_theta(double T,double p){
+   template <typename real>
+   real compute_theta(real T,real p){
 
-   double theta,pi;
+   real theta,pi;
 
    double cp=1004.0;   // specific heat of dry air at constant pressure
    double rgas=287.0;  // gas constant for dry air
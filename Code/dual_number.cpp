@@ -0,0 +1,181 @@
+// 
+// dual_number.cpp
+// Forward mode automatic differentiation. A 'dual' carries a value
+// and its partial derivatives with respect to DUAL_N seeded inputs.
+// Running the templated kernels with 'dual' in place of 'double' gives
+// the profile and its exact sensitivities in a single pass.
+//
+// The seeded inputs used by the model are
+//
+//    DUAL_TC   initial temperature (deg C)
+//    DUAL_QV   initial water vapor mixing ratio
+//    DUAL_PMB  starting pressure (mb)
+//
+// The initial relative humidity is not among them. It is only reported
+// back as the RH of level 0 and never enters the dynamics, so all its
+// derivatives would be zero.
+//
+// Comparisons only look at the value, so branches in the kernels are
+// taken exactly as they would be with plain doubles.
+//
+// ver. 1.0
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #define DUAL_N   3
+
+   #define DUAL_TC  0
+   #define DUAL_QV  1
+   #define DUAL_PMB 2
+
+   struct dual {
+      double v;          // value
+      double d[DUAL_N];  // partial derivatives
+
+      dual(double x = 0){
+         v = x;
+         for (int k=0; k < DUAL_N; k++){ d[k] = 0; }
+      }
+   };
+
+// An independent variable, d(x)/d(input k) = 1
+   dual dual_seed(double x, int k){
+      dual r(x);
+      r.d[k] = 1;
+      return r;
+   }
+
+// So the kernels can pull a plain number out of either type.
+   inline double value_of(double x){ return x; }
+   inline double value_of(const dual& x){ return x.v; }
+
+
+// --------------------------------------------------------------------
+// Arithmetic
+// --------------------------------------------------------------------
+
+   inline dual operator-(const dual& a){
+      dual r(-a.v);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = -a.d[k]; }
+      return r;
+   }
+
+   inline dual operator+(const dual& a, const dual& b){
+      dual r(a.v + b.v);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = a.d[k] + b.d[k]; }
+      return r;
+   }
+
+   inline dual operator-(const dual& a, const dual& b){
+      dual r(a.v - b.v);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = a.d[k] - b.d[k]; }
+      return r;
+   }
+
+   inline dual operator*(const dual& a, const dual& b){
+      dual r(a.v * b.v);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = a.d[k]*b.v + a.v*b.d[k]; }
+      return r;
+   }
+
+   inline dual operator/(const dual& a, const dual& b){
+      dual r(a.v / b.v);
+      double inv = 1.0 / b.v;
+      for (int k=0; k < DUAL_N; k++){
+         r.d[k] = (a.d[k] - r.v*b.d[k]) * inv;
+      }
+      return r;
+   }
+
+// Mixed forms, so constants don't pay for a full dual product.
+   inline dual operator+(const dual& a, double b){
+      dual r = a; r.v += b; return r;
+   }
+   inline dual operator+(double a, const dual& b){ return b + a; }
+   
+   inline dual operator-(const dual& a, double b){
+      dual r = a; r.v -= b; return r;
+   }
+   inline dual operator-(double a, const dual& b){ return -b + a; }
+
+   inline dual operator*(const dual& a, double b){
+      dual r(a.v * b);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = a.d[k] * b; }
+      return r;
+   }
+   inline dual operator*(double a, const dual& b){ return b * a; }
+   
+   inline dual operator/(const dual& a, double b){ return a * (1.0/b); }
+   inline dual operator/(double a, const dual& b){ return dual(a) / b; }
+
+   inline dual& operator+=(dual& a, const dual& b){ a = a + b; return a; }
+   inline dual& operator-=(dual& a, const dual& b){ a = a - b; return a; }
+   inline dual& operator*=(dual& a, const dual& b){ a = a * b; return a; }
+   inline dual& operator/=(dual& a, const dual& b){ a = a / b; return a; }
+
+
+// --------------------------------------------------------------------
+// Comparisons, value only
+// --------------------------------------------------------------------
+
+   inline bool operator<(const dual& a, const dual& b){ return a.v < b.v; }
+   inline bool operator>(const dual& a, const dual& b){ return a.v > b.v; }
+   inline bool operator<=(const dual& a, const dual& b){ return a.v <= b.v; }
+   inline bool operator>=(const dual& a, const dual& b){ return a.v >= b.v; }
+   inline bool operator==(const dual& a, const dual& b){ return a.v == b.v; }
+   inline bool operator!=(const dual& a, const dual& b){ return a.v != b.v; }
+
+
+// --------------------------------------------------------------------
+// Functions used by the kernels. f(a) has derivative f'(a.v) * a.d
+// --------------------------------------------------------------------
+
+   inline dual dual_chain(const dual& a, double f, double dfda){
+      dual r(f);
+      for (int k=0; k < DUAL_N; k++){ r.d[k] = dfda * a.d[k]; }
+      return r;
+   }
+
+   inline dual log10(const dual& a){
+      return dual_chain(a, ::log10(a.v), 1.0 / (a.v * M_LN10));
+   }
+
+   inline dual log(const dual& a){
+      return dual_chain(a, ::log(a.v), 1.0 / a.v);
+   }
+
+   inline dual exp(const dual& a){
+      double e = ::exp(a.v);
+      return dual_chain(a, e, e);
+   }
+
+   inline dual fabs(const dual& a){
+      return a.v < 0 ? -a : a;
+   }
+
+// a^b with constant exponent
+   inline dual pow(const dual& a, double b){
+      double f = ::pow(a.v, b);
+      return dual_chain(a, f, b * ::pow(a.v, b - 1));
+   }
+
+// b^a with constant base
+   inline dual pow(double b, const dual& a){
+      double f = ::pow(b, a.v);
+      return dual_chain(a, f, f * ::log(b));
+   }
+
+   inline dual pow(const dual& a, const dual& b){
+      return exp(b * log(a));
+   }
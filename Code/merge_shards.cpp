@@ -0,0 +1,446 @@
+//
+// merge_shards.cpp
+// Stitches the output of a sharded run ('--shard k/N') back together.
+// Shards hold contiguous blocks of trials in order, so the merged file
+// is shard 0 followed by the data lines of shards 1 to N-1, which is
+// byte for byte what a single process would have written.
+//
+// Each shard is checked against the checkpoint it keeps, '.ckpt' next
+// to it: it must have finished its whole block of trials, and the file
+// must be exactly as long as the checkpoint says. A shard that was
+// killed, or has a torn last row, stops the merge.
+//
+// Runs with '--sounding' also leave 'cape.txt.shard-k-of-N' next to
+// the results, those are merged into 'cape.txt' along with them. The
+// checkpoints say whether there are any, and all shards must agree.
+//
+// Compressed shards (<results file> ending in .pmz) are decoded and
+// coded again as one stream, which gives the same blocks a single
+// process would have written.
+//
+// With '--parts' it reads the output of a '--split-output' run instead,
+// <results file>.idx and its parts, and writes the trials in order.
+//
+// To compile:
+// $ make merge
+//
+// Usage: p_model_merge <results file> <N>
+//    reads <results file>.shard-k-of-N for k = 0 .. N-1
+//        p_model_merge <results file> --parts
+//
+// Adam Abernathy, adam.abernathy@utah.edu
+// Jeff Fitzgerald, j.fitzgerald@utah.edu
+//
+
+// --------------------------------------------------------------------
+//    Headers & Compiler options
+// --------------------------------------------------------------------
+
+   #include <fstream>
+   #include <iostream>
+   #include <stdlib.h>
+   #include <stdio.h>
+   #include <string.h>
+   #include <string>
+   #include <vector>
+   
+   #include "write_output.cpp"
+   #include "pmz_codec.cpp"
+   #include "trial_index.cpp"
+   #include "checkpoint.cpp"
+
+   using namespace std;
+
+
+   string shard_name(const string& out_name, int k, int n_shards){
+      return out_name + ".shard-" + to_string(k) + "-of-" + 
+             to_string(n_shards);
+   }
+
+
+// Is shard k of N complete? 'n_trials' is the ensemble size and
+// 'cape_output' whether CAPE/CIN were written, both taken from shard 0
+// and checked against the others. Returns 0 if it is.
+   int check_shard(const string& out_name, int k, int n_shards, 
+                   long* n_trials, int* cape_output){
+
+      string name = shard_name(out_name, k, n_shards);
+      string ckpt_name = name + ".ckpt";
+      run_checkpoint C;
+      
+      if ( ckpt_read(ckpt_name.c_str(), &C) != 0 ){
+         printf("%s has no checkpoint (%s), can't tell if it is "
+                "complete\n", name.c_str(), ckpt_name.c_str());
+         return 1;
+      }
+      
+      if ( k == 0 ){
+         *n_trials = C.n_trials;
+         *cape_output = C.cape_output;
+      }
+      
+      long last = C.n_trials * (k + 1) / n_shards;
+      
+      if ( C.n_trials != *n_trials ){
+         printf("%s is from a run of %ld trials, shard 0 from %ld\n",
+                name.c_str(), C.n_trials, *n_trials);
+         return 1;
+      }
+      
+      if ( C.cape_output != *cape_output ){
+         printf("%s %s CAPE output, shard 0 %s\n", name.c_str(),
+                C.cape_output ? "has" : "has no",
+                *cape_output ? "does" : "doesn't");
+         return 1;
+      }
+      
+      if ( C.trials_done != last ){
+         printf("%s stopped at trial %ld of %ld, resume it first\n",
+                name.c_str(), C.trials_done, last);
+         return 1;
+      }
+      
+      struct stat st;
+      if ( stat(name.c_str(), &st) != 0 ){
+         perror(name.c_str());
+         return 1;
+      }
+      
+      if ( st.st_size != C.output_bytes ){
+         printf("%s is %lld bytes, its checkpoint says %ld\n", name.c_str(),
+                (long long)st.st_size, C.output_bytes);
+         return 1;
+      }
+      
+      return 0;
+      
+   } // End check_shard
+
+
+// Copies the rest of 'in' to 'out'. Returns 0 on success.
+   int copy_rest(FILE* in, FILE* out){
+
+      char buf[1 << 16];
+      size_t n;
+      
+      while ( (n = fread(buf, 1, sizeof(buf), in)) > 0 ){
+         if ( fwrite(buf, 1, n, out) != n ){ return 1; }
+      }
+      
+      return ferror(in) ? 1 : 0;
+      
+   } // End copy_rest
+
+
+// Appends every row of an open shard to 'w'. Returns 0 on success.
+   int merge_pmz_shard(pmz_reader* r, pmz_writer* w){
+
+      if ( r->hdr.n_steps != w->hdr.n_steps || 
+           r->hdr.first_row != w->next_row ){
+         printf("Shard does not continue where the last one ended\n");
+         return 1;
+      }
+      
+      vector<double> cols[PMZ_N_COLS];
+      
+      for (size_t b=0; b < r->index.size(); b++){
+      
+         if ( pmz_read_block(r, b, cols) != 0 ){
+            printf("Damaged block in shard\n");
+            return 1;
+         }
+         
+         for (size_t i=0; i < cols[0].size(); i++){
+            if ( pmz_append_row(w, cols[0][i], cols[1][i], cols[2][i],
+                                cols[3][i], cols[4][i]) != 0 ){
+               return 1;
+            }
+            if ( w->next_row % w->hdr.n_steps == 0 && 
+                 pmz_end_trial(w) != 0 ){
+               return 1;
+            }
+         }
+      }
+      
+      return 0;
+      
+   } // End merge_pmz_shard
+
+
+   int merge_pmz(const string& out_name, int n_shards){
+
+      string tmp_name = out_name + ".tmp";
+      pmz_writer* w = NULL;
+      int status = 0;
+      
+      long n_trials = 0;
+      int cape_output = 0;
+      
+      for (int k=0; k < n_shards && status == 0; k++){
+      
+         string name = shard_name(out_name, k, n_shards);
+         
+         if ( check_shard(out_name, k, n_shards, &n_trials,
+                          &cape_output) != 0 ){
+            status = 1;
+            break;
+         }
+                       
+         pmz_reader* r = pmz_open_read(name);
+         if ( r == NULL ){
+            status = 1;
+            break;
+         }
+         
+         if ( w == NULL ){
+            w = pmz_open_write(tmp_name, r->hdr.n_steps, 0, 0);
+            if ( w == NULL ){ status = 1; }
+         }
+         
+         if ( status == 0 ){ status = merge_pmz_shard(r, w); }
+         
+         pmz_close_read(r);
+      }
+      
+      if ( w != NULL && pmz_close(w) != 0 ){ status = 1; }
+      
+      if ( status != 0 || rename(tmp_name.c_str(), out_name.c_str()) != 0 ){
+         printf("Merge failed, %s not written\n", out_name.c_str());
+         remove(tmp_name.c_str());
+         return 1;
+      }
+      
+      printf("Merged %d shards into %s\n", n_shards, out_name.c_str());
+      
+      return 0;
+      
+   } // End merge_pmz
+
+
+// Split output, the trials are read back through the index in order.
+   int merge_parts(const string& out_name){
+
+      ti_reader* r = ti_open_read(out_name);
+      if ( r == NULL ){ return 1; }
+      
+      string tmp_name = out_name + ".tmp";
+      ofstream out(tmp_name, ios::out | ios::binary);
+      int status = out.is_open() ? 0 : 1;
+      
+      if ( status == 0 ){ write_output_header(out); }
+      
+      uint64_t trial;
+      string text;
+      int more;
+      
+      while ( status == 0 && (more = ti_next(r, &trial, &text)) != 0 ){
+         if ( more < 0 ){
+            printf("Trial %llu is missing from the parts\n", 
+                   (unsigned long long)trial);
+            status = 1;
+         }else{
+            out << text;
+         }
+      }
+      
+      out.close();
+      if ( out.fail() ){ status = 1; }
+      
+      if ( status != 0 || rename(tmp_name.c_str(), out_name.c_str()) != 0 ){
+         printf("Merge failed, %s not written\n", out_name.c_str());
+         remove(tmp_name.c_str());
+         ti_close_read(r);
+         return 1;
+      }
+      
+      printf("Merged %llu trials from %u parts into %s\n",
+             (unsigned long long)r->hdr.n_trials, r->hdr.n_parts,
+             out_name.c_str());
+             
+      ti_close_read(r);
+      
+      return 0;
+      
+   } // End merge_parts
+
+
+// CAPE/CIN shards of a '--sounding' run, one row per trial. Each shard
+// must hold exactly the trials of its block, in order. Writes into
+// 'tmp_name'. Returns 0 on success.
+   int merge_cape(const string& cape_name, const string& tmp_name,
+                  int n_shards, long n_trials){
+
+      ofstream out(tmp_name, ios::out | ios::binary);
+      if ( !out.is_open() ){
+         perror(tmp_name.c_str());
+         return 1;
+      }
+      
+      string header;
+      
+      for (int k=0; k < n_shards; k++){
+      
+         string name = shard_name(cape_name, k, n_shards);
+         ifstream in(name, ios::in | ios::binary);
+         if ( !in.is_open() ){
+            perror(name.c_str());
+            return 1;
+         }
+         
+         long first = n_trials * k / n_shards;
+         long last = n_trials * (k + 1) / n_shards;
+         long trial = first;
+         string line;
+         
+         if ( !getline(in, line) || line.empty() || line[0] != '#' || 
+              (k > 0 && line != header) ){
+            printf("%s has no header or a different one\n", name.c_str());
+            return 1;
+         }
+         if ( k == 0 ){
+            header = line;
+            out << line << '\n';
+         }
+         
+         while ( getline(in, line) ){
+            if ( in.eof() || trial >= last || 
+                 atol(line.c_str()) != trial ){
+               printf("%s should hold trials %ld to %ld, row for trial "
+                      "%ld is wrong or torn\n", name.c_str(), first, 
+                      last - 1, trial);
+               return 1;
+            }
+            out << line << '\n';
+            trial++;
+         }
+         
+         if ( trial != last ){
+            printf("%s stops at trial %ld of %ld\n", name.c_str(), trial,
+                   last);
+            return 1;
+         }
+      }
+      
+      out.close();
+      
+      return out.fail() ? 1 : 0;
+      
+   } // End merge_cape
+
+
+// --------------------------------------------------------------------
+//    MAIN()
+// --------------------------------------------------------------------
+
+   int main(int nbargs, char* args[]) {
+
+   if ( nbargs != 3 ){
+      printf("Usage: %s <results file> <N>\n", args[0]);
+      printf("       %s <results file> --parts\n", args[0]);
+      return 1;
+   }
+   
+   string out_name = args[1];
+   
+   if ( strcmp(args[2], "--parts") == 0 ){
+      return merge_parts(out_name);
+   }
+   int n_shards = atoi(args[2]);
+   
+   if ( n_shards < 1 ){
+      printf("N must be at least 1\n");
+      return 1;
+   }
+
+   if ( out_name.size() > 4 && 
+        out_name.compare(out_name.size() - 4, 4, ".pmz") == 0 ){
+      return merge_pmz(out_name, n_shards);
+   }
+
+// Write to a temporary and rename, so a failed merge never leaves a
+// results file that looks complete.
+   string tmp_name = out_name + ".tmp";
+   FILE* out = fopen(tmp_name.c_str(), "wb");
+   if ( out == NULL ){
+      perror(tmp_name.c_str());
+      return 1;
+   }
+   
+   string header;
+   int status = 0;
+   long n_trials = 0;
+   int do_cape = 0;
+   
+   for (int k=0; k < n_shards && status == 0; k++){
+   
+      string name = shard_name(out_name, k, n_shards);
+      
+      if ( check_shard(out_name, k, n_shards, &n_trials, &do_cape) != 0 ){
+         status = 1;
+         break;
+      }
+                    
+      FILE* in = fopen(name.c_str(), "rb");
+      if ( in == NULL ){
+         perror(name.c_str());
+         status = 1;
+         break;
+      }
+
+// Rows always end in a newline, anything else was cut off.
+      if ( fseek(in, -1, SEEK_END) == 0 && fgetc(in) != '\n' ){
+         printf("%s does not end in a newline, the last row is torn\n",
+                name.c_str());
+         fclose(in);
+         status = 1;
+         break;
+      }
+      rewind(in);
+
+// Every shard starts with the same header line, keep the first one.
+      char line[1024];
+      if ( fgets(line, sizeof(line), in) == NULL || line[0] != '#' ){
+         printf("%s has no header, is the shard complete?\n", name.c_str());
+         status = 1;
+         
+      }else if ( k == 0 ){
+         header = line;
+         if ( fputs(line, out) < 0 ){ status = 1; }
+         
+      }else if ( header != line ){
+         printf("%s has a different header from shard 0\n", name.c_str());
+         status = 1;
+      }
+      
+      if ( status == 0 ){ status = copy_rest(in, out); }
+      
+      fclose(in);
+   }
+   
+   if ( fclose(out) != 0 ){ status = 1; }
+
+// CAPE/CIN from a '--sounding' run sit in 'cape.txt' beside the results.
+   string cape_name = out_name.substr(0, out_name.rfind('/') + 1) + 
+                      "cape.txt";
+   string cape_tmp = cape_name + ".tmp";
+   
+   if ( status == 0 && do_cape == 1 ){
+      status = merge_cape(cape_name, cape_tmp, n_shards, n_trials);
+   }
+   
+   if ( status != 0 || rename(tmp_name.c_str(), out_name.c_str()) != 0 ||
+        (do_cape == 1 && rename(cape_tmp.c_str(), cape_name.c_str()) != 0) ){
+      printf("Merge failed, %s not written\n", out_name.c_str());
+      remove(tmp_name.c_str());
+      remove(cape_tmp.c_str());
+      return 1;
+   }
+   
+   printf("Merged %d shards into %s\n", n_shards, out_name.c_str());
+   if ( do_cape == 1 ){
+      printf("Merged %d shards into %s\n", n_shards, cape_name.c_str());
+   }
+   
+   return 0;
+   
+   }  //  End main()
@@ -0,0 +1,140 @@
+// 
+// parcel_client.cpp
+// Small client library for the parcel server. Connects to the Unix
+// socket, sends a request and hands each returned profile to a
+// callback as it arrives.
+//
+// Requires: parcel_structs.cpp, parcel_protocol.cpp
+//
+// ver. 1.0
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - Long error messages are read to the end
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <sys/socket.h>
+   #include <sys/un.h>
+
+// Called once per trial. 'AB' is only valid for the duration of the
+// call, copy out anything you want to keep.
+   typedef void (*pm_profile_callback)(int trial, 
+                                       const packaged_computations& AB,
+                                       void* ctx);
+
+
+// --------------------------------------------------------------------
+// Returns a connected socket, or -1.
+// --------------------------------------------------------------------
+
+   int pm_client_connect(const char* sock_path){
+
+      struct sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      
+      if ( strlen(sock_path) >= sizeof(addr.sun_path) ){ return -1; }
+      strcpy(addr.sun_path, sock_path);
+
+      int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if ( fd < 0 ){ return -1; }
+
+      if ( connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ){
+         close(fd);
+         return -1;
+      }
+      
+      return fd;
+      
+   } // End pm_client_connect
+
+
+// --------------------------------------------------------------------
+// Sends 'rq' and reads profiles until the server says DONE. The
+// connection can be reused for further requests.
+//
+// Returns the number of profiles received, or -1 on a protocol or
+// server error (the server's message is printed).
+// --------------------------------------------------------------------
+
+   int pm_client_run(int fd, const pm_request& rq,
+                     pm_profile_callback on_profile, void* ctx){
+
+      if ( pm_send_frame(fd, PM_REQUEST, &rq, sizeof(rq)) != 0 ){
+         return -1;
+      }
+
+// One receive buffer per call, the driver's structure is big enough
+// that it doesn't belong on a small stack.
+      packaged_computations* AB = new packaged_computations;
+      int n_received = 0;
+      int status = -1;
+      
+      pm_frame_header hdr;
+      
+      while ( pm_recv_header(fd, &hdr) == 0 ){
+      
+         if ( hdr.type == PM_DONE ){
+            status = n_received;
+            break;
+         }
+         
+         if ( hdr.type == PM_ERROR ){
+            char msg[256];
+            size_t n = hdr.length < sizeof(msg)-1 ? hdr.length : sizeof(msg)-1;
+            
+            if ( pm_read_full(fd, msg, n) != 0 ){ break; }
+            msg[n] = '\0';
+            printf("Parcel server error: %s\n", msg);
+            
+// Skip what didn't fit, so the next request starts on a frame.
+            char skip[256];
+            size_t left = hdr.length - n;
+            while ( left > 0 ){
+               size_t m = left < sizeof(skip) ? left : sizeof(skip);
+               if ( pm_read_full(fd, skip, m) != 0 ){ break; }
+               left -= m;
+            }
+            break;
+         }
+         
+         if ( hdr.type != PM_PROFILE ){ break; }
+
+         pm_profile_header ph;
+         if ( pm_read_full(fd, &ph, sizeof(ph)) != 0 ){ break; }
+         
+         if ( ph.n_steps < 0 || ph.n_steps > cmax ||
+              hdr.length != sizeof(ph) + PM_N_COLUMNS*ph.n_steps*sizeof(double) ){
+            break;
+         }
+         
+         size_t col = ph.n_steps * sizeof(double);
+         if ( pm_read_full(fd, AB->p_mb, col) != 0 ||
+              pm_read_full(fd, AB->theta_K, col) != 0 ||
+              pm_read_full(fd, AB->T_K, col) != 0 ||
+              pm_read_full(fd, AB->qv_gkg, col) != 0 ||
+              pm_read_full(fd, AB->qc_gkg, col) != 0 ||
+              pm_read_full(fd, AB->rh, col) != 0 ){
+            break;
+         }
+         AB->n_steps = ph.n_steps;
+         
+         if ( on_profile != NULL ){ on_profile(ph.trial, *AB, ctx); }
+         n_received++;
+         
+      } // End while, frames
+      
+      delete AB;
+      
+      return status;
+      
+   } // All done!
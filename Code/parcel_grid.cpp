@@ -0,0 +1,224 @@
+//
+// parcel_grid.cpp
+// Two dimensional grid mode (--grid). Parcels are launched from every
+// point of an X x Z field of initial conditions:
+//    X   a horizontal transect, TC and qv varying together from one
+//        end to the other (--grid-tc, --grid-qv)
+//    Z   the launch pressure (--grid-pmb)
+// All other parameters are those of a normal run. The columns are
+// handed out to '--threads' threads one at a time, so threads that get
+// cheap (dry) columns simply take more of them.
+//
+// Output is one binary array, native byte order:
+//    pg_header
+//    uint32 n_steps[nz][nx]         levels actually used per column
+//    double data[nz][nx][n_levels][PG_N_VARS]
+// with the variables P (mb), T (K), TH (K), QV (g/kg), QC (g/kg) as
+// in 'results.txt'. 'n_levels' is that of the lowest launch level,
+// columns launched higher are padded with NaN. Every column has a
+// fixed place in the file, threads write them directly with pwrite.
+// 'sat_phase' in the header tells liquid grids from '--ice' ones.
+//
+// Requires: adiabat_table.cpp (for at_axis, at_parse_axis),
+//           compute_esat_ice.cpp (for sat_phase)
+//
+// ver. 1.0
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <atomic>
+   #include <thread>
+   #include <vector>
+
+   #define PG_MAGIC  0x44524750   // "PGRD"
+   #define PG_N_VARS 5            // P, T, TH, QV, QC
+
+   struct pg_header {
+      uint32_t magic;
+      uint32_t n_vars;
+      uint32_t nx;
+      uint32_t nz;
+      uint32_t n_levels;         // levels per column in the file
+      uint32_t sat_phase;        // SAT_PHASE_LIQUID or _MIXED
+      at_axis tc;                // X, deg C
+      at_axis qv;                // X, kg/kg
+      at_axis pmb;               // Z, launch pressure (mb)
+      double dpMB;
+      double ptopMB;
+      double qc, qw, qvs, rh_i;  // the rest of the initial state
+      double pert_scalar;
+   };
+
+
+// Value at node i of an axis, a single node sits at 'lo'.
+   double pg_node(const at_axis& A, int i){
+      return A.n < 2 ? A.lo : A.lo + (A.hi - A.lo) * i / (A.n - 1);
+   }
+
+   long pg_levels(double pMB, double dpMB, double ptopMB){
+      return 2 * (long)((pMB-ptopMB)/dpMB) + 1;
+   }
+
+
+// Collects one column for the streaming driver.
+   struct pg_column_sink {
+      double* out;
+      long n_max;
+      long n;
+
+      void operator()(const parcel_level& L){
+         if ( n < n_max ){
+            double* row = out + n * PG_N_VARS;
+            row[0] = L.p_mb;
+            row[1] = L.T_K();
+            row[2] = L.theta_K;
+            row[3] = L.qv_gkg;
+            row[4] = L.qc_gkg;
+         }
+         n++;
+      }
+   };
+
+
+// Runs one column into 'out' (n_max levels). Returns the number of
+// levels filled.
+   long pg_solve_column(const pg_header& H, double pMB, double TC,
+                        double qv, double* out, long n_max){
+
+      if ( pg_levels(pMB, H.dpMB, H.ptopMB) <= cmax ){
+
+         packaged_computations AB;
+         AB = parcel_motion_driver(pMB, TC, qv, H.qc, H.qw, H.qvs, H.rh_i,
+                                   H.dpMB, H.ptopMB, 0);
+
+         long n = AB.n_steps < n_max ? AB.n_steps : n_max;
+         if ( n < 0 ){ n = 0; }
+         for (long k=0; k < n; k++){
+            double* row = out + k * PG_N_VARS;
+            row[0] = AB.p_mb[k];
+            row[1] = AB.T_K[k];
+            row[2] = AB.theta_K[k];
+            row[3] = AB.qv_gkg[k];
+            row[4] = AB.qc_gkg[k];
+         }
+         return n;
+      }
+
+      pg_column_sink sink = { out, n_max, 0 };
+      parcel_motion_stream(pMB, TC, qv, H.qc, H.qw, H.qvs, H.rh_i,
+                           H.dpMB, H.ptopMB, 0, sink);
+
+      long n = sink.n < n_max ? sink.n : n_max;
+      return n < 0 ? 0 : n;
+
+   } // End pg_solve_column
+
+
+// --------------------------------------------------------------------
+// Runs the grid into 'path'. 'pert' holds the temperature perturbation
+// of each column, [nz][nx]. Returns 0 on success.
+// --------------------------------------------------------------------
+
+   int run_parcel_grid(const char* path, const pg_header& hdr,
+                       const std::vector<double>& pert, int n_threads){
+
+      pg_header H = hdr;
+      H.magic = PG_MAGIC;
+      H.n_vars = PG_N_VARS;
+      H.nx = H.tc.n;
+      H.nz = H.pmb.n;
+      H.sat_phase = sat_phase;
+
+      if ( H.nx < 1 || H.nz < 1 || H.qv.n != H.tc.n ){
+         printf("Grid needs at least one column, and as many qv as TC\n");
+         return 1;
+      }
+
+// The lowest launch sets the column length, the highest must still
+// be below ptop.
+      double p_low = H.pmb.lo > H.pmb.hi ? H.pmb.lo : H.pmb.hi;
+      double p_high = H.pmb.lo > H.pmb.hi ? H.pmb.hi : H.pmb.lo;
+      long n_levels = pg_levels(p_low, H.dpMB, H.ptopMB);
+
+      if ( !(p_high > H.ptopMB) || n_levels < 1 ){
+         printf("Grid launch pressures must all be more than ptop "
+                "(%g mb)\n", H.ptopMB);
+         return 1;
+      }
+      H.n_levels = n_levels;
+
+      size_t n_cols = (size_t)H.nx * H.nz;
+      size_t col_len = (size_t)n_levels * PG_N_VARS;
+      off_t data_start = sizeof(pg_header) + n_cols * sizeof(uint32_t);
+
+      int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if ( fd < 0 ){
+         perror(path);
+         return 1;
+      }
+
+      if ( pwrite(fd, &H, sizeof(H), 0) != (ssize_t)sizeof(H) ||
+           ftruncate(fd, data_start + n_cols * col_len * sizeof(double)) != 0 ){
+         perror(path);
+         close(fd);
+         return 1;
+      }
+
+      printf("> Grid %u x %u columns, %ld levels, %d threads\n",
+             H.nx, H.nz, n_levels, n_threads);
+
+      std::atomic<size_t> next(0);
+      std::atomic<int> n_errors(0);
+
+      auto worker = [&](){
+
+         std::vector<double> col(col_len);
+         size_t c;
+
+         while ( (c = next++) < n_cols ){
+            int ix = c % H.nx;
+            int iz = c / H.nx;
+
+            for (size_t k=0; k < col_len; k++){ col[k] = NAN; }
+
+            uint32_t n = pg_solve_column(H, pg_node(H.pmb, iz),
+                                         pg_node(H.tc, ix) + pert[c],
+                                         pg_node(H.qv, ix), &col[0],
+                                         n_levels);
+
+            size_t bytes = col_len * sizeof(double);
+            if ( pwrite(fd, &n, sizeof(n), sizeof(H) + c * sizeof(n))
+                    != (ssize_t)sizeof(n) ||
+                 pwrite(fd, &col[0], bytes, data_start + c * bytes)
+                    != (ssize_t)bytes ){
+               n_errors++;
+            }
+         }
+      };
+
+      if ( n_threads < 1 ){ n_threads = 1; }
+      std::vector<std::thread> pool;
+      for (int t=0; t < n_threads; t++){ pool.push_back(std::thread(worker)); }
+      for (int t=0; t < n_threads; t++){ pool[t].join(); }
+
+      if ( close(fd) != 0 || n_errors > 0 ){
+         printf("> Error writing %s!\n", path);
+         return 1;
+      }
+
+      printf("> Grid written to %s\n", path);
+
+      return 0;
+
+   } // End run_parcel_grid
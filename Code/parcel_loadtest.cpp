@@ -0,0 +1,160 @@
+//
+// parcel_loadtest.cpp
+// Load generator for the parcel server. Opens one connection per
+// client thread, fires requests back to back and reports latency
+// percentiles and throughput.
+//
+// To compile:
+// $ make loadtest
+//
+// Usage: p_model_loadtest <socket> [n_requests] [n_clients] [n_trials]
+//
+// Adam Abernathy, adam.abernathy@utah.edu
+// Jeff Fitzgerald, j.fitzgerald@utah.edu
+//
+
+// --------------------------------------------------------------------
+//    Headers & Compiler options
+// --------------------------------------------------------------------
+
+   #include <iostream>
+   #include <stdlib.h>
+   #include <stdio.h>
+   #include <string.h>
+   #include <time.h>
+   #include <vector>
+   #include <thread>
+   #include <algorithm>
+
+   #include "parcel_structs.cpp"
+   #include "parcel_protocol.cpp"
+   #include "parcel_client.cpp"
+
+   using namespace std;
+
+
+// Per client results
+   struct lt_client {
+      const char* sock_path;
+      int n_requests;
+      pm_request rq;
+      vector<double> latency_us;
+      long n_profiles;
+      int n_errors;
+   };
+
+   double lt_now_us(){
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec * 1.e6 + ts.tv_nsec * 1.e-3;
+   }
+
+   void lt_run_client(lt_client* C){
+
+      int fd = pm_client_connect(C->sock_path);
+      if ( fd < 0 ){
+         C->n_errors = C->n_requests;
+         return;
+      }
+      
+      for (int i=0; i < C->n_requests; i++){
+      
+         double t0 = lt_now_us();
+         int n = pm_client_run(fd, C->rq, NULL, NULL);
+         double t1 = lt_now_us();
+         
+         if ( n < 0 ){
+            C->n_errors++;
+            break;
+         }
+         
+         C->n_profiles += n;
+         C->latency_us.push_back(t1 - t0);
+      }
+      
+      close(fd);
+      
+   } // End lt_run_client
+
+
+// --------------------------------------------------------------------
+//    MAIN()
+// --------------------------------------------------------------------
+
+   int main(int nbargs, char* args[]) {
+
+   if ( nbargs < 2 ){
+      printf("Usage: %s <socket> [n_requests] [n_clients] [n_trials]\n",
+             args[0]);
+      return 1;
+   }
+   
+   const char* sock_path = args[1];
+   int n_requests = nbargs > 2 ? atoi(args[2]) : 1000;
+   int n_clients  = nbargs > 3 ? atoi(args[3]) : 1;
+   int n_trials   = nbargs > 4 ? atoi(args[4]) : 1;
+
+// Same initial conditions as 'run_parcel_model.csh'
+   pm_request rq;
+   memset(&rq, 0, sizeof(rq));
+   rq.pMB = 1000.0;
+   rq.dpMB = 10.0;
+   rq.ptopMB = 500.0;
+   rq.TC = 20.0;
+   rq.qv = 14.8e-3;
+   rq.qc = 0.0;
+   rq.qw = 14.8e-3;
+   rq.qvs = 0.0;
+   rq.rh_i = 0.5;
+   rq.pert = 0.01;
+   rq.n_trials = n_trials;
+   rq.flags = 0;
+
+   vector<lt_client> clients(n_clients);
+   vector<thread> threads;
+   
+   double t0 = lt_now_us();
+   
+   for (int c=0; c < n_clients; c++){
+      clients[c].sock_path = sock_path;
+      clients[c].n_requests = n_requests;
+      clients[c].rq = rq;
+      clients[c].n_profiles = 0;
+      clients[c].n_errors = 0;
+      threads.push_back(thread(lt_run_client, &clients[c]));
+   }
+   
+   for (int c=0; c < n_clients; c++){ threads[c].join(); }
+   
+   double elapsed = (lt_now_us() - t0) * 1.e-6;
+
+// Pool everyone's latencies and report
+   vector<double> all;
+   long n_profiles = 0;
+   int n_errors = 0;
+   
+   for (int c=0; c < n_clients; c++){
+      all.insert(all.end(), clients[c].latency_us.begin(),
+                 clients[c].latency_us.end());
+      n_profiles += clients[c].n_profiles;
+      n_errors += clients[c].n_errors;
+   }
+   
+   if ( all.empty() ){
+      printf("No requests completed (%d errors)\n", n_errors);
+      return 1;
+   }
+   
+   sort(all.begin(), all.end());
+   size_t n = all.size();
+
+   printf("\nRequests:   %zu ok, %d failed\n", n, n_errors);
+   printf("Profiles:   %ld\n", n_profiles);
+   printf("Latency:    min %.1f  p50 %.1f  p99 %.1f  max %.1f [us]\n",
+          all[0], all[n/2], all[(size_t)(0.99*(n-1))], all[n-1]);
+   printf("Throughput: %.0f req/s, %.0f profiles/s\n\n",
+          n / elapsed, n_profiles / elapsed);
+   
+   return n_errors == 0 ? 0 : 1;
+   
+   }  //  End main()
@@ -3,6 +3,7 @@
 //    
 // To compile:
 // $ g++ parcel_model_r4.cpp -o parcel_model_R4_build_2 -lm -std=c++11
+//      -pthread -O2 -ffp-contract=off    (all on one line), or 'make'
 //
 // Adam Abernathy, adam.abernathy@utah.edu
 // Jeff Fitzgerald, j.fitzgerald@utah.edu
@@ -14,6 +15,7 @@
 
    #include <fstream>
    #include <iostream>
+   #include <sstream>
    #include <stdlib.h>
    #include <stdio.h>
    #include <string.h>
@@ -21,51 +23,56 @@
    #include <time.h>
    #include <array>
    
-   #define cmax 1000     // 'cmax' is the max size of the 
-                         // packaged_computation's arrays.
-
-   struct adjusted_sat {
-      double theta; // adj. potential temperature, theta^{n+1} (K)
-      double qv;    // adj. mixing water vapor rat., q_v^{n+1} (kg/kg)
-      double qc;    // adj. mixing liquid water rat., q_c^{n+1} (kg/kg)
-      double qvs;   // sat mixing rat., q_vs^{n+1} (kg/kg),TH1, PBAR
-      double pibar; // Exner function, pi (non-dimensional pressure)
-   }; 
-                     
-   struct packaged_computations {
-      double p_mb[cmax];
-      double theta_K[cmax];
-      double T_K[cmax];
-      double qv_gkg[cmax];
-      double qc_gkg[cmax];
-      double rh[cmax];
-      int n_steps;
-   };
+   #include "parcel_structs.cpp"
+   #include "dual_number.cpp"
 
    #include "terminal_lib.cpp"
    #include "compute_theta.cpp"
    #include "compute_esat_pa.cpp"
    #include "compute_des_dt_pa.cpp"
    #include "compute_alpha.cpp"
+   #include "compute_esat_ice.cpp"
+   #include "perf_counters.cpp"
    #include "satadjust.cpp"
+   #include "sounding.cpp"
    #include "write_output.cpp"
+   #include "pmz_codec.cpp"
+   #include "trial_index.cpp"
+   #include "write_sensitivity.cpp"
    #include "parcel_motion_driver.cpp"
+   #include "stream_sinks.cpp"
+   #include "projection.cpp"
+   #include "parcel_profile.cpp"
+   #include "result_cache.cpp"
+   #include "checkpoint.cpp"
+   #include "split_ensemble.cpp"
+   #include "adiabat_table.cpp"
+   #include "parcel_grid.cpp"
+   #include "parcel_protocol.cpp"
+   #include "parcel_server.cpp"
       
    using namespace std;
 
 // Function declaration   
 
-// Computation functions    
-   double compute_theta(double T, double p);
-   double compute_esat_pa(double T);
-   double compute_des_dt_pa(double T);
-   double compute_alpha(double pbar, double pibar, double tstar);
+// Computation functions, templated on the scalar type so they also
+// run on 'dual' numbers (see 'dual_number.cpp')
+   template <typename real> real compute_theta(real T, real p);
+   template <typename real> real compute_esat_pa(real T);
+   template <typename real> real compute_des_dt_pa(real T);
+   template <typename real> 
+      real compute_alpha(real pbar, real pibar, real tstar);
    
-   adjusted_sat compute_satadjust(double theta,
-      double qv,double qc,double p);
+   template <typename real> 
+      adjusted_sat_t<real> compute_satadjust(real theta,
+         real qv,real qc,real p);
       
    double random_pertubate(double scalar);
+   void skip_random_pertubate(long n);
 
+// Daemon mode, found in 'parcel_server.cpp'
+   int run_parcel_server(const char* sock_path, int n_workers,
+                         result_cache* rc);
 
 // Console output functions, found in 'terminal_lib.cpp'  
    void print_parcel(double p_mb, double theta_K, double T_K,
@@ -79,12 +86,15 @@
    void write_output_csv(double p_mb[], double theta_K[], double T_K[],
                          double qv[], double qc[], double rh[],
                          int n_steps, int append_flag, 
-                         const std::string& f);
+                         const std::string& f, double buoy[]);
+   void write_sensitivity_csv(const packaged_computations_t<dual>& AB,
+                              const std::string& f);
                          
 // Parcel motion driver                       
-   packaged_computations parcel_motion_driver(double pMB, double TC, 
-      double qv, double qc, double qw, double qvs, double rh_i, 
-      double dpMB, double ptopMB, int console_output);
+   template <typename real>
+   packaged_computations_t<real> parcel_motion_driver(real pMB, real TC, 
+      real qv, real qc, real qw, real qvs, real rh_i, 
+      real dpMB, real ptopMB, int console_output);
 
    
 // --------------------------------------------------------------------
@@ -105,12 +115,181 @@
    int do_write_output,do_console_output,n_trials;
    double pMB,TC,qv,qvs,qc,qw,rh_i,dpMB,ptopMB,pert_scalar;
 
+// Pull any '--option' flags out of the argument list first. What is
+// left is packed back into 'args' so the positional parameters below
+// are read exactly as before.
+   const char* serve_path = NULL; // Unix socket for daemon mode
+   int n_workers = 4;             // daemon worker pool size
+   const char* cache_path = NULL; // result cache file, NULL = no cache
+   double cache_mb = 64;          // memory tier cap (MB)
+   double cache_disk_mb = 256;    // disk tier cap (MB)
+   const char* ckpt_path = NULL;  // checkpoint file, NULL = none
+   long ckpt_every = 0;           // trials between checkpoints
+   int do_resume = 0;             // pick up from 'ckpt_path'?
+   int do_sensitivity = 0;        // one dual number pass instead?
+   int n_threads = std::thread::hardware_concurrency();
+   int shard_k = 0, shard_n = 1;  // run only slice k of N of the trials
+   int do_stream = 0;             // stream levels straight to the file?
+   int do_compress = 0;           // write results.pmz instead of text?
+   int do_profile = 0;            // hardware counter report, no output
+   int do_split = 0;              // one output part per thread + index?
+   const char* sounding_path = NULL; // environment for buoyancy, CAPE
+   out_projection proj;           // variables and levels written
+   proj.vars = 0;                 // 0 = the default columns
+   proj.stride = 1;
+   int do_project = 0;            // any of --vars, --levels, --level-stride?
+   const char* grid_path = NULL;     // grid mode output, NULL = off
+   at_axis grid_axes[3] = { {0, 0, 0, 0},   // TC, n = 0 is unset
+                            {0, 0, 0, 0},   // qv
+                            {0, 0, 0, 0} }; // pMB
+   const char* build_table = NULL;   // adiabat table to build
+   const char* query_table = NULL;   // adiabat table to query
+   at_axis table_axes[AT_N_AXES] = { {950., 1050., 5, 0},  // pMB0
+                                     {0., 35., 8, 0},      // TC
+                                     {2.e-3, 20.e-3, 10, 0} }; // qv
+
+   int n_pos = 1;
+   for (int a = 1; a < nbargs; a++){
+      if ( strcmp(args[a],"--serve") == 0 && a+1 < nbargs ){
+         serve_path = args[++a];
+      }else if ( strcmp(args[a],"--workers") == 0 && a+1 < nbargs ){
+         n_workers = atoi(args[++a]);
+      }else if ( strcmp(args[a],"--cache") == 0 && a+1 < nbargs ){
+         cache_path = args[++a];
+      }else if ( strcmp(args[a],"--cache-mb") == 0 && a+1 < nbargs ){
+         cache_mb = atof(args[++a]);
+      }else if ( strcmp(args[a],"--cache-disk-mb") == 0 && a+1 < nbargs ){
+         cache_disk_mb = atof(args[++a]);
+      }else if ( strcmp(args[a],"--checkpoint") == 0 && a+1 < nbargs ){
+         ckpt_path = args[++a];
+      }else if ( strcmp(args[a],"--checkpoint-every") == 0 && a+1 < nbargs ){
+         ckpt_every = atol(args[++a]);
+      }else if ( strcmp(args[a],"--resume") == 0 ){
+         do_resume = 1;
+      }else if ( strcmp(args[a],"--sensitivity") == 0 ){
+         do_sensitivity = 1;
+      }else if ( strcmp(args[a],"--shard") == 0 && a+1 < nbargs ){
+         if ( sscanf(args[++a], "%d/%d", &shard_k, &shard_n) != 2 ||
+              shard_n < 1 || shard_k < 0 || shard_k >= shard_n ){
+            printf("Bad shard '%s', want k/N with 0 <= k < N\n", args[a]);
+            return 1;
+         }
+      }else if ( strcmp(args[a],"--stream") == 0 ){
+         do_stream = 1;
+      }else if ( strcmp(args[a],"--compress") == 0 ){
+         do_compress = 1;
+      }else if ( strcmp(args[a],"--split-output") == 0 ){
+         do_split = 1;
+      }else if ( strcmp(args[a],"--sounding") == 0 && a+1 < nbargs ){
+         sounding_path = args[++a];
+      }else if ( strcmp(args[a],"--vars") == 0 && a+1 < nbargs ){
+         if ( proj_parse_vars(args[++a], &proj.vars) != 0 ){ return 1; }
+         proj.spec += string(" --vars ") + args[a];
+         do_project = 1;
+      }else if ( strcmp(args[a],"--levels") == 0 && a+1 < nbargs ){
+         if ( proj_parse_levels(args[++a], &proj.p_mb) != 0 ){ return 1; }
+         proj.spec += string(" --levels ") + args[a];
+         do_project = 1;
+      }else if ( strcmp(args[a],"--level-stride") == 0 && a+1 < nbargs ){
+         proj.stride = atol(args[++a]);
+         if ( proj.stride < 1 ){
+            printf("Bad level stride '%s'\n", args[a]);
+            return 1;
+         }
+         proj.spec += string(" --level-stride ") + args[a];
+         do_project = 1;
+      }else if ( strcmp(args[a],"--ice") == 0 ){
+         sat_phase = SAT_PHASE_MIXED;
+      }else if ( strcmp(args[a],"--profile") == 0 ){
+         do_profile = 1;
+      }else if ( strcmp(args[a],"--threads") == 0 && a+1 < nbargs ){
+         n_threads = atoi(args[++a]);
+      }else if ( strcmp(args[a],"--build-table") == 0 && a+1 < nbargs ){
+         build_table = args[++a];
+      }else if ( strcmp(args[a],"--query-table") == 0 && a+1 < nbargs ){
+         query_table = args[++a];
+      }else if ( strcmp(args[a],"--grid") == 0 && a+1 < nbargs ){
+         grid_path = args[++a];
+      }else if ( strncmp(args[a],"--grid-",7) == 0 && a+1 < nbargs ){
+         int ax = strcmp(args[a],"--grid-tc") == 0 ? 0 :
+                  strcmp(args[a],"--grid-qv") == 0 ? 1 :
+                  strcmp(args[a],"--grid-pmb") == 0 ? 2 : -1;
+         if ( ax < 0 || at_parse_axis(args[++a], &grid_axes[ax]) != 0 ||
+              grid_axes[ax].n < 1 ){
+            printf("Bad grid axis '%s %s', want lo:hi:n\n", args[a-1], args[a]);
+            return 1;
+         }
+      }else if ( strncmp(args[a],"--table-",8) == 0 && a+1 < nbargs ){
+         int ax = strcmp(args[a],"--table-pmb") == 0 ? 0 :
+                  strcmp(args[a],"--table-tc") == 0 ? 1 :
+                  strcmp(args[a],"--table-qv") == 0 ? 2 : -1;
+         if ( ax < 0 || at_parse_axis(args[++a], &table_axes[ax]) != 0 ){
+            printf("Bad table axis '%s %s', want lo:hi:n\n", args[a-1], args[a]);
+            return 1;
+         }
+      }else if ( strncmp(args[a],"--",2) == 0 ){
+         printf("Ignoring unknown option '%s'\n", args[a]);
+      }else{
+         args[n_pos++] = args[a];
+      }
+   }
+   nbargs = n_pos;
+
+   if ( sat_phase == SAT_PHASE_MIXED ){
+      printf("> Mixed-phase saturation adjustment (liquid and ice)\n");
+   }
+
+// Daemon mode, requests arrive over the socket so none of the
+// positional parameters apply.
+   if ( serve_path != NULL ){
+      result_cache* rc = NULL;
+      if ( cache_path != NULL ){
+         rc = rc_open(cache_path, cache_mb, cache_disk_mb, cmax);
+      }
+      return run_parcel_server(serve_path, n_workers, rc);
+   }
+
+// Adiabat table queries, 'pMB0 TC qv p' lines arrive on stdin.
+   if ( query_table != NULL ){
+   
+      adiabat_table* tab = at_open(query_table);
+      if ( tab == NULL ){ return 1; }
+      
+      double x0, x1, x2, x3, out[AT_N_VARS];
+      printf("# P0_MB, TC, QV, P_MB, TH, T, QV, QC, CLAMPED\n");
+      
+      while ( scanf("%lf %lf %lf %lf", &x0, &x1, &x2, &x3) == 4 ){
+         int clamped = at_query(tab, x0, x1, x2, x3, out);
+         printf("%g,%g,%g,%g,%g,%g,%g,%g,%d\n", x0, x1, x2, x3,
+                out[0], out[1], out[2], out[3], clamped);
+      }
+      
+      at_close(tab);
+      return 0;
+   }
+
 // Deal with command line arguments
    if(nbargs!=14) { 
    
       printf("Using default parameters ...\n");
       printf("Usage: <do_output> <do_console> <pert> <ntrials> \n");
       printf("<pMB> <dp> <ptop> <TC> <qv> <qc> <qw> <qvs> <rh>\n");
+      printf("   or: --serve <socket> [--workers <n>]\n");
+      printf("Options: --cache <file> [--cache-mb <n>] "
+             "[--cache-disk-mb <n>]\n");
+      printf("         --checkpoint <file> [--checkpoint-every <n>] "
+             "[--resume]\n");
+      printf("         --sensitivity\n");
+      printf("         --shard <k/N>, --stream, --compress\n");
+      printf("         --split-output [--threads <n>]\n");
+      printf("         --ice, --profile [--threads <n>]\n");
+      printf("         --sounding <file>\n");
+      printf("         --vars <P,T,TH,QV,QC,RH,B>, --levels <p,p,..>, "
+             "--level-stride <n>\n");
+      printf("         --grid <file> [--grid-tc|qv|pmb lo:hi:n] "
+             "[--threads <n>]\n");
+      printf("         --build-table <file> [--table-pmb|tc|qv lo:hi:n]\n");
+      printf("         --query-table <file> < 'pMB0 TC qv p' lines\n");
       
       printf("\nSee 'readme' for more information\n");      
 
@@ -171,13 +350,342 @@
 // We now have our initialization parameters, so lets get going...
 // --------------------------------------------------------------------
 
+// The environmental sounding, lined up with the pressure levels of
+// this run before any parcel starts. Every trial shares the index.
+   if ( sounding_path != NULL ){
+   
+      if ( do_compress == 1 || do_split == 1 || grid_path != NULL ||
+           ckpt_path != NULL || do_resume == 1 || ckpt_every > 0 ){
+         printf("--sounding can't be combined with --compress, "
+                "--split-output, --grid or checkpoints\n");
+         return 1;
+      }
+      
+      snd_profile S;
+      if ( snd_read(sounding_path, &S) != 0 ){ return 1; }
+      
+      snd_index* E = snd_build_index(S, pMB, dpMB, ptopMB);
+      printf("> Sounding %s, %zu levels from %g to %g mb\n", sounding_path,
+             S.p_mb.size(), S.p_mb.front(), S.p_mb.back());
+             
+      if ( E->n_clamped > 0 ){
+         printf("> %d levels outside the sounding use its end values\n",
+                E->n_clamped);
+      }
+      
+      env_sounding = E;
+   }
+
+// Output projection, the kept levels are marked once for this grid.
+   if ( do_project == 1 ){
+   
+      if ( do_compress == 1 || do_split == 1 || grid_path != NULL ){
+         printf("--vars and --levels can't be combined with --compress, "
+                "--split-output or --grid\n");
+         return 1;
+      }
+      
+      if ( proj.vars == 0 ){
+         proj.vars = OUT_DEFAULT_VARS;
+         if ( env_sounding != NULL ){ proj.vars |= 1u << OUT_B; }
+      }
+      
+      if ( (proj.vars & (1u << OUT_B)) && env_sounding == NULL ){
+         printf("Buoyancy (B) needs a --sounding\n");
+         return 1;
+      }
+      
+      if ( proj_build(&proj, pMB, dpMB, ptopMB) != 0 ){ return 1; }
+   }
+
+// Adiabat table build, uses dp and ptop from the parameters above.
+   if ( build_table != NULL ){
+   
+      printf("> Building adiabat table %s ...\n", build_table);
+      
+      if ( at_build(build_table, table_axes, dpMB, ptopMB, 200,
+                    n_threads) != 0 ){ return 1; }
+                    
+      adiabat_table* tab = at_open(build_table);
+      if ( tab == NULL ){ return 1; }
+      at_print_info(tab);
+
+// Time the lookups, cycling through points spread over the domain.
+      int n_q = 1000000;
+      double out[AT_N_VARS], sink = 0;
+      clock_t t0 = clock();
+      
+      for (int j=0; j < n_q; j++){
+         double f = (j % 1000) * 1.e-3;
+         at_query(tab, table_axes[0].lo + f*(table_axes[0].hi-table_axes[0].lo),
+                  table_axes[1].lo + f*(table_axes[1].hi-table_axes[1].lo),
+                  table_axes[2].lo + f*(table_axes[2].hi-table_axes[2].lo),
+                  table_axes[0].lo - (j % 37)*dpMB*0.5, out);
+         sink += out[1];
+      }
+      
+      double ns = 1.e9 * (clock() - t0) / CLOCKS_PER_SEC / n_q;
+      printf("> %.0f ns per query (check %g)\n", ns, sink / n_q);
+      
+      at_close(tab);
+      printf("> Complete.\n\n");
+      return 0;
+   }
+   
+// Profiling mode, the same trials an ensemble run would make but
+// nothing is written, only the counter report.
+   if ( do_profile == 1 ){
+   
+      vector<double> TC_trials(n_trials);
+      for (int i=0; i < n_trials; i++){
+         TC_trials[i] = TC + random_pertubate(pert_scalar);
+      }
+      
+      return run_parcel_profile(pMB, TC_trials, qv, qc, qw, qvs, rh_i,
+                                dpMB, ptopMB, n_threads);
+   }
+   
+// Grid mode. Axes left unset stay at the point given by the
+// parameters, the TC and qv transects share their column count.
+   if ( grid_path != NULL ){
+   
+      pg_header H;
+      memset(&H, 0, sizeof(H));
+      H.tc = grid_axes[0];
+      H.qv = grid_axes[1];
+      H.pmb = grid_axes[2];
+      
+      if ( H.tc.n == 0 ){ H.tc.lo = H.tc.hi = TC;  H.tc.n = H.qv.n; }
+      if ( H.qv.n == 0 ){ H.qv.lo = H.qv.hi = qv;  H.qv.n = H.tc.n; }
+      if ( H.tc.n == 0 ){ H.tc.n = H.qv.n = 1; }
+      if ( H.pmb.n == 0 ){ H.pmb.lo = H.pmb.hi = pMB;  H.pmb.n = 1; }
+      
+      H.dpMB = dpMB;   H.ptopMB = ptopMB;
+      H.qc = qc;   H.qw = qw;   H.qvs = qvs;   H.rh_i = rh_i;
+      H.pert_scalar = pert_scalar;
+
+// Perturbations are drawn up front, in column order, so the grid does
+// not depend on which thread ran which column.
+      vector<double> pert((size_t)H.tc.n * H.pmb.n);
+      for (size_t c=0; c < pert.size(); c++){
+         pert[c] = random_pertubate(pert_scalar);
+      }
+      
+      int status = run_parcel_grid(grid_path, H, pert, n_threads);
+      
+      if ( status == 0 ){ printf("> Complete.\n\n"); }
+      return status;
+   }
+   
+// Sensitivity mode. A single unperturbed run on dual numbers gives the
+// profiles and their derivatives with respect to TC, qv and pMB,
+// instead of estimating them from a perturbed ensemble.
+   if ( do_sensitivity == 1 ){
+   
+      packaged_computations_t<dual>* S = new packaged_computations_t<dual>;
+      
+      *S = parcel_motion_driver(dual_seed(pMB,DUAL_PMB), 
+                                dual_seed(TC,DUAL_TC),
+                                dual_seed(qv,DUAL_QV), dual(qc), dual(qw),
+                                dual(qvs), dual(rh_i),
+                                dual(dpMB), dual(ptopMB),
+                                do_console_output);
+                                
+      if ( do_write_output == 1 ){
+         write_sensitivity_csv(*S, "sensitivity.txt");
+         printf("> Sensitivities written to sensitivity.txt\n");
+      }
+      
+      delete S;
+      
+      printf("> Complete.\n\n");
+      return 0;
+      
+   } // End IF, do_sensitivity
+
    int append_flag = 0;  // Append to text file?
+   string ff = do_compress == 1 ? "results.pmz" : "results.txt";
+
+// Sharding. Shard k of N runs the contiguous block of trials
+// [first, last) into its own file, and 'p_model_merge' stitches the
+// shards back into the file a single process would have written.
+   long first = (long)n_trials * shard_k / shard_n;
+   long last = (long)n_trials * (shard_k + 1) / shard_n;
    
+   if ( shard_n > 1 ){
+      ff += ".shard-" + to_string(shard_k) + "-of-" + to_string(shard_n);
+      printf("> Shard %d of %d, trials %ld to %ld\n", shard_k, shard_n,
+             first, last - 1);
+   }
+
+// More shards than trials leaves some empty, they still need a file
+// for the merge to find.
+   if ( first == last && do_write_output == 1 && do_compress == 0 ){
+      if ( do_project == 1 ){
+         ofstream results_file(ff, ios::out);
+         proj_write_header(results_file, proj);
+      }else{
+         write_output_csv(NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, ff, NULL);
+      }
+   }
+
+// Runs with more levels than the packaged arrays hold (very small dp)
+// always stream, each level goes straight to the results file.
+   long n_levels = 2 * (long)((pMB-ptopMB)/dpMB) + 1;
+   
+   if ( n_levels > cmax && do_stream == 0 ){
+      printf("> %ld levels per trial, streaming output\n", n_levels);
+      do_stream = 1;
+   }
+
+// Only unperturbed runs repeat, so only they are worth caching.
+   result_cache* rc = NULL;
+   if ( cache_path != NULL && pert_scalar == 0 ){
+      rc = rc_open(cache_path, cache_mb, cache_disk_mb, n_levels);
+   }
+
+// Projected runs stream, so only the wanted values are ever formed.
+// Cached runs already have the whole profile and just write less.
+   if ( do_project == 1 && rc == NULL ){ do_stream = 1; }
+
+// Split output, the trials run in parallel and each thread writes its
+// own part of the results. Trials are perturbed in order up front, so
+// the parts hold the same trials a serial run would have made.
+   if ( do_split == 1 && do_write_output == 1 ){
+   
+      if ( do_compress == 1 || ckpt_path != NULL || do_resume == 1 ||
+           ckpt_every > 0 ){
+         printf("--split-output can't be combined with --compress or "
+                "checkpoints\n");
+         return 1;
+      }
+      
+      skip_random_pertubate(first);
+      vector<double> TC_trials(last - first);
+      for (size_t i=0; i < TC_trials.size(); i++){
+         TC_trials[i] = TC + random_pertubate(pert_scalar);
+      }
+      
+      uint64_t n_bytes = 0;
+      int status = run_split_ensemble(ff, pMB, TC_trials, qv, qc, qw, qvs,
+                                      rh_i, dpMB, ptopMB, first, do_stream,
+                                      rc, n_threads, &n_bytes);
+
+// A shard still needs its checkpoint for 'p_model_merge'. It describes
+// the file 'p_model_merge <shard> --parts' makes of the parts, the
+// header and then the text of every trial. Split runs can't resume, so
+// the parameters aren't fingerprinted.
+      if ( status == 0 && shard_n > 1 ){
+         ostringstream header;
+         write_output_header(header);
+         
+         run_checkpoint ckpt;
+         ckpt.n_trials = n_trials;
+         ckpt.trials_done = last;
+         ckpt.rng_draws = 2 * last;
+         ckpt.output_bytes = header.str().size() + n_bytes;
+         ckpt.params = 0;
+         ckpt.cape_output = 0;
+         
+         status = ckpt_write((ff + ".ckpt").c_str(), ckpt) == 0 ? 0 : 1;
+      }
+      
+      rc_print_stats(rc);
+      rc_close(rc);
+      
+      printf("> Complete.\n\n");
+      return status;
+   }
+
+// Checkpointing. Every 'ckpt_every' trials we record how far we got,
+// and '--resume' starts from the last record instead of trial 0.
+// Sharded runs always keep one, the merge checks each shard is
+// complete against it.
+   string ckpt_default = ff + ".ckpt";
+   if ( ckpt_path == NULL && (do_resume == 1 || ckpt_every > 0 ||
+                              (shard_n > 1 && do_write_output == 1)) ){
+      ckpt_path = ckpt_default.c_str();
+   }
+   if ( ckpt_every < 1 ){ ckpt_every = 1000; }
+   
+   double run_params[] = { (double)(do_write_output + 2*do_compress +
+                                    4*sat_phase), 
+      pert_scalar,
+      (double)n_trials, pMB, dpMB, ptopMB, TC, qv, qc, qw, qvs, rh_i,
+      (double)shard_k, (double)shard_n };
+      
+   run_checkpoint ckpt;
+   ckpt.n_trials = n_trials;
+   ckpt.trials_done = first;
+   ckpt.rng_draws = 2 * first;
+   ckpt.output_bytes = 0;
+   ckpt.params = ckpt_fingerprint(run_params, shard_n > 1 ? 14 : 12);
+   ckpt.cape_output = env_sounding != NULL && do_write_output == 1;
+   
+   if ( do_project == 1 ){
+      ckpt.params = rc_fnv1a(proj.spec.data(), proj.spec.size(), ckpt.params);
+   }
+   
+   if ( do_resume == 1 ){
+   
+      run_checkpoint prev;
+      
+      if ( ckpt_read(ckpt_path, &prev) != 0 ){
+         printf("> No usable checkpoint in %s, starting over.\n", ckpt_path);
+         
+      }else if ( prev.params != ckpt.params || prev.trials_done < first ||
+                 prev.trials_done > last ){
+         printf("> Checkpoint %s is for different parameters!\n", ckpt_path);
+         return 1;
+         
+      }else{
+// Anything written after the checkpoint belongs to trials we are
+// about to run again.
+         if ( do_write_output == 1 && prev.trials_done > first &&
+              truncate(ff.c_str(), prev.output_bytes) != 0 ){
+            perror(ff.c_str());
+            return 1;
+         }
+         
+         ckpt = prev;
+         
+         printf("> Resuming at trial %ld of %d\n", ckpt.trials_done, n_trials);
+      }
+   } // End IF, do_resume
+
+// Shards and resumed runs start part way through the random sequence.
+   skip_random_pertubate(ckpt.trials_done);
+
+// Compressed output goes through one writer for the whole run. Rows
+// are numbered across the full ensemble, so shards and resumed runs
+// continue the numbering where they start.
+   pmz_writer* pmz = NULL;
+   
+   if ( do_write_output == 1 && do_compress == 1 ){
+      pmz = pmz_open_write(ff, n_levels, (uint64_t)first * n_levels,
+                           (uint64_t)ckpt.trials_done * n_levels);
+      if ( pmz == NULL ){ return 1; }
+   }
+
+// With a sounding, CAPE and CIN of each trial go to their own file,
+// 'cape.txt' next to the results.
+   ofstream cape_file;
+   
+   if ( env_sounding != NULL && do_write_output == 1 ){
+      string fc = "cape.txt" + ff.substr(string("results.txt").size());
+      cape_file.open(fc, ios::out);
+      if ( !cape_file.is_open() ){
+         cout << "File I/O Error! Check Output file.";
+      }
+      cape_file << "# TRIAL, CAPE, CIN" << endl;
+   }
+   
+   double cape = 0, cin = 0;
 
 // Initialize simulation loop
-   for (int i=0; i < n_trials; i++){   
+   for (long i=ckpt.trials_done; i < last; i++){   
    
-   if ( n_trials == 1 || i == 0 ){
+   if ( i == first ){
       append_flag = 0; // no
    }else{
       append_flag = 1; // yes
@@ -190,24 +698,146 @@
 // working and output variables are declared internally to the 
 // parcel motion driver in order to keep their scope limited, thus
 // limiting the potential for SEGFAULTS.
+   if ( do_stream == 1 ){
+   
+      double TC_i = TC + random_pertubate(pert_scalar);
+      
+      if ( pmz != NULL ){
+         pmz_stream_sink sink = { pmz };
+         parcel_motion_stream(pMB,TC_i,qv,qc,qw,qvs,rh_i,dpMB,ptopMB,
+                              do_console_output,sink);
+                              
+      }else if ( do_write_output == 1 ){
+         ofstream results_file(ff, append_flag == 1 ? 
+                               ios::out | ios::app : ios::out);
+         if ( !results_file.is_open() ){
+            cout << "File I/O Error! Check Output file.";
+         }
+         if ( append_flag == 0 && do_project == 1 ){
+            proj_write_header(results_file, proj);
+         }else if ( append_flag == 0 ){ 
+            write_output_header(results_file, env_sounding != NULL); 
+         }
+         
+         if ( do_project == 1 ){
+            projecting_sink sink = { &results_file, &proj, 0, 0 };
+            parcel_motion_stream(pMB,TC_i,qv,qc,qw,qvs,rh_i,dpMB,ptopMB,
+                                 do_console_output,sink);
+            cape = sink.cape;
+            cin = sink.cin;
+         }else{
+            csv_stream_sink sink = { &results_file, env_sounding != NULL,
+                                     0, 0 };
+            parcel_motion_stream(pMB,TC_i,qv,qc,qw,qvs,rh_i,dpMB,ptopMB,
+                                 do_console_output,sink);
+            cape = sink.cape;
+            cin = sink.cin;
+         }
+      }else{
+         reducing_sink sink;
+         parcel_motion_stream(pMB,TC_i,qv,qc,qw,qvs,rh_i,dpMB,ptopMB,
+                              do_console_output,sink);
+         cape = sink.last.cape;
+         cin = sink.last.cin;
+      }
+      
+   }else{
+
    packaged_computations AB;
-   AB = parcel_motion_driver(pMB, TC + random_pertubate(pert_scalar),
+   AB = cached_parcel_motion_driver(rc, 
+                             pMB, TC + random_pertubate(pert_scalar),
                              qv,qc,qw,qvs,rh_i,dpMB,ptopMB,
                              do_console_output);
+   cape = AB.cape;
+   cin = AB.cin;
 
 // Unpack the return structure and save to CSV.  
-  if ( do_write_output == 1 ){
-      //printf("> Saving output ... \n");
+  if ( pmz != NULL ){
+      for (int k=0; k < AB.n_steps; k++){
+         pmz_append_row(pmz, AB.p_mb[k], AB.T_K[k], AB.theta_K[k],
+                        AB.qv_gkg[k], AB.qc_gkg[k]);
+      }
+      
+  }else if ( do_write_output == 1 && do_project == 1 ){
+      ofstream results_file(ff, append_flag == 1 ? 
+                            ios::out | ios::app : ios::out);
+      if ( append_flag == 0 ){ proj_write_header(results_file, proj); }
+      proj_write_packaged(results_file, proj, AB);
       
-      string ff = "results.txt";
-            
+  }else if ( do_write_output == 1 ){
+      //printf("> Saving output ... \n");
+
       write_output_csv(AB.p_mb, AB.theta_K, AB.T_K, AB.qv_gkg,
-                       AB.qc_gkg, AB.rh, AB.n_steps, append_flag, ff);
-        
+                       AB.qc_gkg, AB.rh, AB.n_steps, append_flag, ff,
+                       env_sounding != NULL ? AB.buoy : NULL);
+
    } // End IF, do_write_output
+   
+   } // End IF/ELSE, do_stream
+   
+   if ( pmz != NULL ){ pmz_end_trial(pmz); }
+   
+   if ( env_sounding != NULL ){
+      if ( cape_file.is_open() ){
+         cape_file << i << ',' << cape << ',' << cin << endl;
+      }
+      if ( do_console_output == 1 ){
+         printf("> CAPE %.1f J/kg, CIN %.1f J/kg\n", cape, cin);
+      }
+   }
+
+// Record progress. The results file must be on disk before the
+// checkpoint that points into it. Compressed output is only durable
+// up to its last complete block, trials after that get rerun.
+   if ( ckpt_path != NULL && ((i+1) % ckpt_every == 0 || i+1 == last) ){
+
+      ckpt.trials_done = i+1;
+      ckpt.output_bytes = 0;
+
+      if ( pmz != NULL ){
+         ckpt.trials_done = pmz->durable_rows / n_levels;
+         ckpt.output_bytes = fsync(fileno(pmz->fp)) == 0 ? 
+                             (long)pmz->durable_bytes : -1;
+                             
+      }else if ( do_write_output == 1 ){ 
+         ckpt.output_bytes = ckpt_sync_output(ff); 
+      }
+      
+      ckpt.rng_draws = 2 * ckpt.trials_done;
+
+      if ( ckpt.output_bytes < 0 || ckpt_write(ckpt_path, ckpt) != 0 ){
+         printf("> Checkpoint failed at trial %ld!\n", i+1);
+      }
+   } // End IF, checkpoint
 
    } // End FOR, [i], simulation loop
+
+// An empty shard never reaches the checkpoint in the loop.
+   if ( ckpt_path != NULL && pmz == NULL && first == last ){
+      ckpt.trials_done = last;
+      ckpt.rng_draws = 2 * last;
+      ckpt.output_bytes = do_write_output == 1 ? ckpt_sync_output(ff) : 0;
+      ckpt_write(ckpt_path, ckpt);
+   }
+
+// Closing writes the last block and the index, after which the whole
+// file is durable.
+   if ( pmz != NULL ){
+      if ( pmz_close(pmz) != 0 ){
+         printf("> Error writing %s!\n", ff.c_str());
+      }
+      
+      if ( ckpt_path != NULL ){
+         ckpt.trials_done = last;
+         ckpt.rng_draws = 2 * last;
+         ckpt.output_bytes = ckpt_sync_output(ff);
+         ckpt_write(ckpt_path, ckpt);
+      }
+   }
    
+   rc_print_stats(rc);
+   rc_close(rc);
+
 // Tell the user we are done!
    printf("> Complete.\n\n");
    
@@ -237,5 +867,14 @@
    
    } // end rndm()  
 
+
+// Advances random() past 'n' trials worth of perturbations, exactly as
+// if random_pertubate() had been called 'n' times.
+   void skip_random_pertubate(long n) {
+   
+      for (long j=0; j < 2*n; j++){ random(); }
+      
+   } // end skip_random_pertubate()
+
 // All done!
 
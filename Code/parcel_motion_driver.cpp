@@ -11,15 +11,34 @@
 //             dpMB, d/dt for pMB
 //             ptopMB, max pMB
 //             console_output, boolean int, write to screen?
+//             sink, (streaming version) called with each level
 //
-// Returns:    struct packaged_computations
+// With a sounding loaded (see sounding.cpp) every level also carries
+// its buoyancy, and CAPE/CIN are summed over the ascent as it runs.
 //
-// ver. 1.2
+// Returns:    struct packaged_computations (packaged_computations_t<real>)
+//             or, streaming version, the no. of levels produced
+//
+// 'real' is normally double. Calling with 'dual' arguments carries the
+// derivatives of every level with respect to the seeded inputs.
+//
+// parcel_motion_stream() is the driver proper. It only holds the
+// current parcel state and hands each level to 'sink' as soon as it
+// is computed, so memory use doesn't grow with the number of levels.
+// parcel_motion_driver() is the original interface, a sink that
+// stores the levels into the packaged arrays.
+//
+// ver. 1.5
 // 
 // -- Change log --
 // April 23, 2015 - Initial Release
 // April 27, 2015 - Removed support for directly calling the text
 //                  output function, this is ISO build 4.
+// October 19, 2026 - Templated on the scalar type, see dual_number.cpp
+// October 19, 2026 - Split into a constant memory streaming driver and
+//                    the array packing sink.
+// October 19, 2026 - Buoyancy and CAPE/CIN against the environmental
+//                    sounding.
 //
 // -- Licence --
 // Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
@@ -31,27 +50,23 @@
 //
 // --------------------------------------------------------------------
 
-   packaged_computations parcel_motion_driver(double pMB, double TC, 
-      double qv, double qc, double qw, double qvs, double rh_i, 
-      double dpMB, double ptopMB, int console_output){
+// qw is part of the shared argument list but isn't used by the driver,
+// the total water is carried as qv + qc.
+   template <typename real, typename sink_t>
+   long parcel_motion_stream(real pMB, real TC, real qv, real qc, 
+      real /* qw */, real qvs, real rh_i, real dpMB, real ptopMB, 
+      int console_output, sink_t& sink){
 
    using namespace std;
 
 // --------------------------------------------------------------------
 // Due to the limited scope of this function, we will need to forward
 // declare all the dependent functions. The same applies for the
-// physical constants.
+// physical constants. The computation functions are templates, which
+// can't be declared in here, they come from the includes ahead of
+// this file.
 // --------------------------------------------------------------------
 
-// Computation functions    
-   extern double compute_theta(double T, double p);
-   extern double compute_esat_pa(double T);
-   extern double compute_des_dt_pa(double T);
-   extern double compute_alpha(double pbar, double pibar, double tstar);
-   
-   extern adjusted_sat compute_satadjust(double theta,
-      double qv,double qc,double p);
-
 // Console output functions, found in 'terminal_lib.cpp'  
    extern void print_parcel(double p_mb, double theta_K, double T_K,
       double qv, double qc, double rh);
@@ -72,43 +87,48 @@
 // Convert input parameters to SI units, and create new working
 // variables. We don"t want to alter the orignial ones because we
 // will use them later in our text print outs.
-   double p = pMB * pa_per_mb;         // [Pa]
-   double T = TC + temp_ice;           // [K]
-   double dp = dpMB  * pa_per_mb;      // [Pa]
-   double ptop = ptopMB * pa_per_mb;   // [Pa]
-   double pibar = 0;                   // Unitless
+   real p = pMB * pa_per_mb;         // [Pa]
+   real T = TC + temp_ice;           // [K]
+   real dp = dpMB  * pa_per_mb;      // [Pa]
+   real pibar = 0;                   // Unitless
    
 // Define the initial "theta"
-   double theta = compute_theta(T,p);
+   real theta = compute_theta(T,p);
 
 // 'n_cycles' & 'n_steps' are the number of loop iterations to drive
 // the parcel in a given vertical direction. 'n_cycles' is a single
 // direction and 'n_steps' is the full up & down iterations required.
-   int n_cycles = ( (pMB-ptopMB)/dpMB );
-   int n_steps = (2 * n_cycles) + 1;
+   long n_cycles = value_of( (pMB-ptopMB)/dpMB );
+   long n_steps = (2 * n_cycles) + 1;
 
-// Set up 1D arrays for storing results
-   double p_mb[n_steps],theta_K[n_steps],T_K[n_steps],qv_gkg[n_steps],
-      qvs_gkg,qc_gkg[n_steps],qw_gkg[n_steps],rh[n_steps];
-   
+// The environment, if there is one for this grid. 'dTv' is the parcel
+// minus environment virtual temperature of the previous level.
+   const snd_index* env = snd_for_run(value_of(pMB), value_of(dpMB),
+                                      value_of(ptopMB));
+   real dTv = 0;
+   int above_lfc = 0;
+
+// The current level, this is all the state we keep. The starting
+// values are stored as given (assuming no adjustment req'd).
+   parcel_level_t<real> L;
+   L.i = 0;
+   L.p_mb = pMB;
+   L.theta_K = theta;
+   L.qv_gkg = qv;
+   L.qc_gkg = qc;
+   L.pibar = pibar;
+   L.qvs = qvs;
+   L.T_start = T;
+   L.rh_start = rh_i;
+   L.buoy = 0;
+   L.cape = 0;
+   L.cin = 0;
    
-// Fill arrays with "1", this way we can diagnose any computational
-// errors, by detecting null values.
-   double null_val = -999;
-   std::fill_n(p_mb,n_steps,null_val);
-   std::fill_n(T_K,n_steps,null_val);
-   std::fill_n(qv_gkg,n_steps,null_val);
-   std::fill_n(qc_gkg,n_steps,null_val);
-   std::fill_n(rh,n_steps,null_val);
-
-// Store initial values (assuming no adjustment req'd)
-   p_mb[0] = pMB;
-   theta_K[0] = theta;
-   T_K[0] = T;
-   qv_gkg[0] = qv;
-   qc_gkg[0] = qc;
-   qw_gkg[0] = qw;
-   rh[0] = rh_i;
+   if ( env != NULL ){
+      real Tv_env = snd_env_Tv(env, 0);
+      dTv = snd_virtual_temp(T, qv, qc) - Tv_env;
+      L.buoy = snd_g * dTv / Tv_env;
+   }
 
 
 // --------------------------------------------------------------------
@@ -122,16 +142,19 @@
    
 // Print the starting conditions.
    if ( console_output == 1){
-      print_table_header(TC,qv,qc);
-      print_parcel(p_mb[0],theta_K[0],T_K[0],qv_gkg[0],qc_gkg[0],rh[0]);
+      print_table_header(value_of(TC),value_of(qv),value_of(qc));
+      print_parcel(value_of(L.p_mb),value_of(L.theta_K),value_of(L.T_K()),
+         value_of(L.qv_gkg),value_of(L.qc_gkg),value_of(L.rh()));
       printf("\n");
    } // End IF
 
+   sink(L);
+
 // Loop thru the 'n_steps', this allows us to drive the parcel
 // up and down in the atmosphere.
 
    int flag_1 = 0;   // ascend/descend flag   
-   for ( int i = 1; i <= n_steps -1; i++ ){
+   for ( long i = 1; i <= n_steps -1; i++ ){
    
 // Check to see if we need to descent or not, if so print a message
    if ( i <= n_cycles ){
@@ -153,7 +176,7 @@
 // Adjust the parcel. This is the real "meat & potatoes" ...   
 // Assuming Dry Adiabatic ascent, theta, qv, qc don't change. This is
 // an isobaric saturation adjustment.   
-   adjusted_sat AA = compute_satadjust(theta,qv,qc,p);
+   adjusted_sat_t<real> AA = compute_satadjust(theta,qv,qc,p);
   
 // update the parcel's properties
    qv=AA.qv;
@@ -162,19 +185,40 @@
    pibar=AA.pibar;
    theta=AA.theta;  
   
-// Record & store new variables, and set up the next cycle.
-   p_mb[i] = p / pa_per_mb;
-   theta_K[i] = theta;
-   T_K[i] = theta * pibar;
-   
-   qv_gkg[i] = qv * 1.e3;
-   qc_gkg[i] = qc  * 1.e3;
-   
-   rh[i]= qv_gkg[i] / (qvs*1.e3);
+// Record the new level and pass it on.
+   L.i = i;
+   L.p_mb = p / pa_per_mb;
+   L.theta_K = theta;
+   L.qv_gkg = qv * 1.e3;
+   L.qc_gkg = qc  * 1.e3;
+   L.pibar = pibar;
+   L.qvs = qvs;
+
+// Buoyancy at the matching level of the sounding, on the way down the
+// levels are revisited in reverse. CAPE and CIN only count the ascent.
+   if ( env != NULL ){
+      long j = i <= n_cycles ? i : n_steps - 1 - i;
+      real Tv_env = snd_env_Tv(env, j);
+      real dTv_j = snd_virtual_temp(theta * pibar, qv, qc) - Tv_env;
+      
+      L.buoy = snd_g * dTv_j / Tv_env;
+      
+      if ( i <= n_cycles ){
+         real area = snd_Rd * 0.5 * (dTv + dTv_j) * env->dlnp[j];
+         if ( area > 0 ){
+            L.cape = L.cape + area;
+            above_lfc = 1;
+         }else if ( above_lfc == 0 ){
+            L.cin = L.cin + area;
+         }
+      }
+      dTv = dTv_j;
+   }
 
 // Print data to user
    if ( console_output == 1){
-      print_parcel(p_mb[i],theta_K[i],T_K[i],qv_gkg[i],qc_gkg[i],rh[i]);
+      print_parcel(value_of(L.p_mb),value_of(L.theta_K),value_of(L.T_K()),
+         value_of(L.qv_gkg),value_of(L.qc_gkg),value_of(L.rh()));
 
 // Break the lines up a bit for the user, this makes for easier reading
       int r = 5;
@@ -182,30 +226,67 @@
    
    } // End IF, console output
    
+   sink(L);
+   
    } // end for, [i], ascent & descent
 
    if ( console_output == 1){
       print_table_line();
    }
 
+   return n_steps;
+   
+   } // End parcel_motion_stream
 
 
+// --------------------------------------------------------------------
+// Array packing sink, fills a packaged_computations structure. Levels
+// past 'cmax' don't fit and are dropped, use parcel_motion_stream()
+// directly for runs that long.
+// --------------------------------------------------------------------
+
+   template <typename real>
+   struct packing_sink {
+      packaged_computations_t<real>* AB;
+      
+      void operator()(const parcel_level_t<real>& L){
+         AB->cape = L.cape;
+         AB->cin = L.cin;
+         
+         if ( L.i >= cmax ){ return; }
+         
+         AB->p_mb[L.i] = L.p_mb;
+         AB->theta_K[L.i] = L.theta_K;
+         AB->T_K[L.i] = L.T_K();
+         AB->qv_gkg[L.i] = L.qv_gkg;
+         AB->qc_gkg[L.i] = L.qc_gkg;
+         AB->rh[L.i] = L.rh();
+         AB->buoy[L.i] = L.buoy;
+      }
+   };
+
+
+   template <typename real>
+   packaged_computations_t<real> parcel_motion_driver(real pMB, real TC, 
+      real qv, real qc, real qw, real qvs, real rh_i, 
+      real dpMB, real ptopMB, int console_output){
+
 // Package up the computations and send them back to the main()
 // controller.   
-   packaged_computations AB;  // return structure
+   packaged_computations_t<real> AB;  // return structure
+   packing_sink<real> sink = { &AB };
    
-   for (int i=0;i <= n_steps-1; i++){
-      AB.p_mb[i] = p_mb[i];
-      AB.theta_K[i] = theta_K[i];
-      AB.T_K[i] = T_K[i];
-      AB.qv_gkg[i] = qv_gkg[i];
-      AB.qc_gkg[i] = qc_gkg[i];
-      AB.rh[i] = rh[i];
-      AB.n_steps = n_steps;
+   long n_steps = parcel_motion_stream(pMB,TC,qv,qc,qw,qvs,rh_i,dpMB,
+                                       ptopMB,console_output,sink);
+                                       
+   if ( n_steps > cmax ){
+      printf("> %ld levels exceed cmax (%d), profile truncated!\n",
+             n_steps, cmax);
+      n_steps = cmax;
    }
-
    
-   return AB;
+   AB.n_steps = n_steps;
    
+   return AB;
    
    } // All done!
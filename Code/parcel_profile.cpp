@@ -0,0 +1,281 @@
+//
+// parcel_profile.cpp
+// Profiling mode (--profile). Runs the requested ensemble without
+// writing any output, on '--threads' threads that take trials from a
+// shared counter, and reports hardware counters (perf_counters.cpp)
+// per parcel-step for the driver and per call for the kernels.
+//
+// Each trial is run twice. The first pass is timed as it is, through
+// the driver an ensemble run uses. The second pass runs with the
+// satadjust probe set, which counts the passes of its while loop and
+// the qc1 < 0 branch and keeps the inputs of the calls. Those calls
+// are then replayed on their own, timed:
+//    satadjust           in the order the driver made them
+//    qc1 < 0 taken       only the calls taking the branch ...
+//    qc1 >= 0            ... and only those that never do
+//    esat                compute_esat_pa at the same temperatures
+// Replaying the two classes separately makes the branch predictable,
+// so comparing them with the in-order line shows what its
+// mispredictions cost.
+//
+// ver. 1.0
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <atomic>
+   #include <thread>
+   #include <vector>
+
+   #define PF_CAPTURE_MAX  (1 << 20)  // satadjust calls kept per thread
+   #define PF_REPLAY_CALLS 200000     // replay each phase at least this long
+
+   enum pf_phase_id {
+      PF_DRIVER    = 0,
+      PF_SATADJUST = 1,
+      PF_SA_DRY    = 2,
+      PF_SA_SAT    = 3,
+      PF_ESAT      = 4,
+      PF_N_PHASES  = 5
+   };
+
+   struct pf_job {
+      double pMB, qv, qc, qw, qvs, rh_i, dpMB, ptopMB;
+      const std::vector<double>* TC;   // one per trial
+      long n_levels;
+      std::atomic<long> next;
+   };
+
+   struct pf_report {
+      long trials;
+      int n_events;
+      pc_phase phase[PF_N_PHASES];
+      satadjust_probe_t probe;
+   };
+
+   volatile double pf_sink = 0;   // keeps the replays from being optimized out
+
+
+// One trial through the same path an ensemble run takes. Returns the
+// number of parcel-steps.
+   long pf_run_trial(const pf_job* job, double TC){
+
+      if ( job->n_levels <= cmax ){
+         packaged_computations AB;
+         AB = parcel_motion_driver(job->pMB, TC, job->qv, job->qc, job->qw,
+                                   job->qvs, job->rh_i, job->dpMB,
+                                   job->ptopMB, 0);
+         pf_sink = pf_sink + AB.T_K[AB.n_steps - 1];
+         return AB.n_steps;
+      }
+
+      reducing_sink sink;
+      return parcel_motion_stream(job->pMB, TC, job->qv, job->qc, job->qw,
+                                  job->qvs, job->rh_i, job->dpMB,
+                                  job->ptopMB, 0, sink);
+
+   } // End pf_run_trial
+
+
+// Replays the recorded calls listed in 'order' until at least
+// PF_REPLAY_CALLS have been made, timed into 'ph'.
+   void pf_replay_satadjust(const pc_counters* pc,
+                            const std::vector<sa_probe_call>& calls,
+                            const std::vector<size_t>& order, pc_phase* ph){
+
+      if ( order.empty() ){ return; }
+
+      size_t reps = 1 + PF_REPLAY_CALLS / order.size();
+      double sum = 0;
+      pc_sample a, b;
+
+      pc_read(pc, &a);
+      for (size_t r=0; r < reps; r++){
+         for (size_t k=0; k < order.size(); k++){
+            const sa_probe_call& c = calls[order[k]];
+            adjusted_sat s = compute_satadjust(c.theta, c.qv, c.qc, c.pbar);
+            sum += s.theta;
+         }
+      }
+      pc_read(pc, &b);
+
+      pc_phase_add(ph, a, b, reps * order.size());
+      pf_sink = pf_sink + sum;
+
+   } // End pf_replay_satadjust
+
+
+   void pf_replay_esat(const pc_counters* pc, const std::vector<double>& T,
+                       pc_phase* ph){
+
+      if ( T.empty() ){ return; }
+
+      size_t reps = 1 + PF_REPLAY_CALLS / T.size();
+      double sum = 0;
+      pc_sample a, b;
+
+      pc_read(pc, &a);
+      for (size_t r=0; r < reps; r++){
+         for (size_t k=0; k < T.size(); k++){
+            sum += compute_esat_pa(T[k]);
+         }
+      }
+      pc_read(pc, &b);
+
+      pc_phase_add(ph, a, b, reps * T.size());
+      pf_sink = pf_sink + sum;
+
+   } // End pf_replay_esat
+
+
+   void pf_worker(pf_job* job, pf_report* rep){
+
+      pc_counters pc;
+      rep->n_events = pc_open(&pc);
+      rep->trials = 0;
+
+      const char* names[PF_N_PHASES] = { "driver", "satadjust",
+         "  qc1 < 0 taken", "  qc1 >= 0", "esat" };
+      for (int k=0; k < PF_N_PHASES; k++){
+         pc_phase_init(&rep->phase[k], names[k],
+                       k == PF_DRIVER ? "step" : "call", pc.avail);
+      }
+
+      std::vector<sa_probe_call> calls;
+      sa_probe_init(&rep->probe);
+      rep->probe.capture = &calls;
+      rep->probe.capture_max = PF_CAPTURE_MAX;
+
+      long i;
+      while ( (i = job->next++) < (long)job->TC->size() ){
+
+         double TC = (*job->TC)[i];
+         pc_sample a, b;
+
+         pc_read(&pc, &a);
+         long n = pf_run_trial(job, TC);
+         pc_read(&pc, &b);
+         pc_phase_add(&rep->phase[PF_DRIVER], a, b, n);
+
+         satadjust_probe = &rep->probe;
+         pf_run_trial(job, TC);
+         satadjust_probe = NULL;
+
+         rep->trials++;
+      }
+
+// Kernel replays
+      std::vector<size_t> all, dry, sat;
+      std::vector<double> T;
+
+      for (size_t k=0; k < calls.size(); k++){
+         all.push_back(k);
+         (calls[k].n_dry > 0 ? dry : sat).push_back(k);
+         T.push_back(calls[k].theta * pow(calls[k].pbar / 100000.0,
+                                          287.0 / 1004.0));
+      }
+
+      pf_replay_satadjust(&pc, calls, all, &rep->phase[PF_SATADJUST]);
+      pf_replay_satadjust(&pc, calls, dry, &rep->phase[PF_SA_DRY]);
+      pf_replay_satadjust(&pc, calls, sat, &rep->phase[PF_SA_SAT]);
+      pf_replay_esat(&pc, T, &rep->phase[PF_ESAT]);
+
+      rep->probe.capture = NULL;
+      pc_close(&pc);
+
+   } // End pf_worker
+
+
+   void pf_print_report(const pf_report& rep){
+      pc_print_phase_header();
+      for (int k=0; k < PF_N_PHASES; k++){
+         pc_print_phase(rep.phase[k]);
+      }
+      sa_probe_print(rep.probe);
+   }
+
+
+// --------------------------------------------------------------------
+// Entry point. 'TC' holds the (perturbed) temperature of every trial.
+// Returns 0 on success.
+// --------------------------------------------------------------------
+
+   int run_parcel_profile(double pMB, const std::vector<double>& TC,
+                          double qv, double qc, double qw, double qvs,
+                          double rh_i, double dpMB, double ptopMB,
+                          int n_threads){
+
+      if ( TC.empty() ){
+         printf("> No trials to profile\n");
+         return 0;
+      }
+      
+      if ( n_threads < 1 ){ n_threads = 1; }
+      if ( (size_t)n_threads > TC.size() ){ n_threads = TC.size(); }
+
+      pf_job job;
+      job.pMB = pMB;    job.qv = qv;     job.qc = qc;
+      job.qw = qw;      job.qvs = qvs;   job.rh_i = rh_i;
+      job.dpMB = dpMB;  job.ptopMB = ptopMB;
+      job.TC = &TC;
+      job.n_levels = 2 * (long)((pMB-ptopMB)/dpMB) + 1;
+      job.next = 0;
+
+      printf("> Profiling %zu trials on %d threads\n",
+             TC.size(), n_threads);
+
+      std::vector<pf_report> reps(n_threads);
+      std::vector<std::thread> pool;
+
+      struct timespec t0, t1;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+
+      for (int t=0; t < n_threads; t++){
+         pool.push_back(std::thread(pf_worker, &job, &reps[t]));
+      }
+      for (int t=0; t < n_threads; t++){
+         pool[t].join();
+      }
+
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+
+      if ( n_threads > 0 && reps[0].n_events < PC_N_EVENTS ){
+         printf("> Only %d of %d hardware counters available "
+                "(check perf_event_paranoid), the rest show n/a\n",
+                reps[0].n_events, PC_N_EVENTS);
+      }
+
+// Per thread, then everything together
+      pf_report total = reps[0];
+      for (int t=0; t < n_threads; t++){
+         printf("\n> Thread %d, %ld trials\n", t, reps[t].trials);
+         pf_print_report(reps[t]);
+
+         if ( t > 0 ){
+            for (int k=0; k < PF_N_PHASES; k++){
+               pc_phase_merge(&total.phase[k], reps[t].phase[k]);
+            }
+            sa_probe_merge(&total.probe, reps[t].probe);
+            total.trials += reps[t].trials;
+         }
+      }
+
+      double wall = (t1.tv_sec - t0.tv_sec) + 1.e-9 * (t1.tv_nsec - t0.tv_nsec);
+
+      printf("\n> All threads, %ld trials in %.3f s\n", total.trials, wall);
+      pf_print_report(total);
+      printf("\n");
+
+      return 0;
+
+   } // End run_parcel_profile
@@ -0,0 +1,195 @@
+// 
+// parcel_protocol.cpp
+// Wire format for talking to the parcel server over a Unix domain
+// socket. Every message is a fixed header followed by 'length' bytes
+// of payload. Both ends live on the same host, so values are sent in
+// native byte order.
+//
+//    REQUEST  client -> server, payload is a pm_request
+//    PROFILE  server -> client, one per trial, pm_profile_header then
+//             the p, theta, T, qv, qc and rh columns (n_steps each)
+//    DONE     server -> client, all trials have been sent
+//    ERROR    server -> client, payload is a text message
+//
+// Requires: parcel_structs.cpp
+//
+// ver. 1.0
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <stdint.h>
+   #include <errno.h>
+   #include <unistd.h>
+   #include <sys/uio.h>
+
+   #define PM_MAGIC      0x524D4450  // "PDMR"
+   #define PM_VERSION    1
+   #define PM_MAX_TRIALS 1000000     // per request, sanity limit
+   #define PM_N_COLUMNS  6           // p, theta, T, qv, qc, rh
+
+   enum pm_frame_type {
+      PM_REQUEST = 1,
+      PM_PROFILE = 2,
+      PM_DONE    = 3,
+      PM_ERROR   = 4
+   };
+
+   struct pm_frame_header {
+      uint32_t magic;
+      uint16_t version;
+      uint16_t type;
+      uint32_t length;   // payload bytes following the header
+   };
+
+   struct pm_request {
+      double pMB;        // starting pressure (mb)
+      double dpMB;       // pressure interval (mb)
+      double ptopMB;     // ending pressure (mb)
+      double TC;         // temperature (deg C)
+      double qv;         // water vapor mixing ratio
+      double qc;         // liquid water mixing ratio
+      double qw;
+      double qvs;
+      double rh_i;       // initial RH value
+      double pert;       // perturbation scalar, 0 for none
+      int32_t n_trials;  // no. of trials to run
+      uint32_t flags;    // reserved, must be 0
+   };
+
+   struct pm_profile_header {
+      int32_t trial;
+      int32_t n_steps;
+   };
+
+
+// --------------------------------------------------------------------
+// Read or write exactly 'n' bytes, riding out short transfers and
+// interrupted system calls. Returns 0 on success, -1 on error or EOF.
+// --------------------------------------------------------------------
+
+   int pm_read_full(int fd, void* buf, size_t n){
+
+      char* p = (char*)buf;
+      
+      while ( n > 0 ){
+         ssize_t r = read(fd, p, n);
+         
+         if ( r < 0 && errno == EINTR ){ continue; }
+         if ( r <= 0 ){ return -1; }
+         
+         p += r;
+         n -= r;
+      }
+      
+      return 0;
+      
+   } // End pm_read_full
+
+
+// Gather write of an iovec list, advancing through the list as the
+// kernel accepts partial writes.
+   int pm_writev_full(int fd, struct iovec* iov, int n_iov){
+
+      while ( n_iov > 0 ){
+         ssize_t w = writev(fd, iov, n_iov);
+         
+         if ( w < 0 && errno == EINTR ){ continue; }
+         if ( w < 0 ){ return -1; }
+
+         while ( n_iov > 0 && (size_t)w >= iov->iov_len ){
+            w -= iov->iov_len;
+            iov++;
+            n_iov--;
+         }
+         
+         if ( n_iov > 0 ){
+            iov->iov_base = (char*)iov->iov_base + w;
+            iov->iov_len -= w;
+         }
+      }
+      
+      return 0;
+      
+   } // End pm_writev_full
+
+
+// --------------------------------------------------------------------
+// Frame helpers
+// --------------------------------------------------------------------
+
+   int pm_send_frame(int fd, int type, const void* payload, 
+                     uint32_t length){
+
+      pm_frame_header hdr;
+      hdr.magic = PM_MAGIC;
+      hdr.version = PM_VERSION;
+      hdr.type = type;
+      hdr.length = length;
+      
+      struct iovec iov[2];
+      iov[0].iov_base = &hdr;
+      iov[0].iov_len = sizeof(hdr);
+      iov[1].iov_base = (void*)payload;
+      iov[1].iov_len = length;
+      
+      return pm_writev_full(fd, iov, length > 0 ? 2 : 1);
+      
+   } // End pm_send_frame
+
+
+// Reads the next header and checks that it is one of ours.
+   int pm_recv_header(int fd, pm_frame_header* hdr){
+
+      if ( pm_read_full(fd, hdr, sizeof(*hdr)) != 0 ){ return -1; }
+      
+      if ( hdr->magic != PM_MAGIC || hdr->version != PM_VERSION ){
+         return -1;
+      }
+      
+      return 0;
+      
+   } // End pm_recv_header
+
+
+// Sends one computed profile straight out of the driver's arrays, so
+// nothing is copied on the way to the socket.
+   int pm_send_profile(int fd, int trial, 
+                       const packaged_computations& AB){
+
+      int n = AB.n_steps;
+      size_t col = n * sizeof(double);
+      
+      pm_profile_header ph;
+      ph.trial = trial;
+      ph.n_steps = n;
+      
+      pm_frame_header hdr;
+      hdr.magic = PM_MAGIC;
+      hdr.version = PM_VERSION;
+      hdr.type = PM_PROFILE;
+      hdr.length = sizeof(ph) + PM_N_COLUMNS * col;
+      
+      struct iovec iov[2 + PM_N_COLUMNS];
+      iov[0].iov_base = &hdr;             iov[0].iov_len = sizeof(hdr);
+      iov[1].iov_base = &ph;              iov[1].iov_len = sizeof(ph);
+      iov[2].iov_base = (void*)AB.p_mb;    iov[2].iov_len = col;
+      iov[3].iov_base = (void*)AB.theta_K; iov[3].iov_len = col;
+      iov[4].iov_base = (void*)AB.T_K;     iov[4].iov_len = col;
+      iov[5].iov_base = (void*)AB.qv_gkg;  iov[5].iov_len = col;
+      iov[6].iov_base = (void*)AB.qc_gkg;  iov[6].iov_len = col;
+      iov[7].iov_base = (void*)AB.rh;      iov[7].iov_len = col;
+      
+      return pm_writev_full(fd, iov, 2 + PM_N_COLUMNS);
+      
+   } // End pm_send_profile
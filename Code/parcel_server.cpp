@@ -0,0 +1,302 @@
+// 
+// parcel_server.cpp
+// Daemon mode. Listens on a Unix domain socket and answers framed
+// requests (see parcel_protocol.cpp) from a pool of worker threads
+// that stay resident between requests, so callers no longer pay for
+// a process start and a trip through 'results.txt' on every run.
+//
+// Work is handed out per request, not per connection. The accept
+// thread polls every idle connection, and when one has a request
+// waiting it goes on the queue. A worker answers that one request and
+// hands the connection back to be polled. So any number of persistent
+// clients share the pool, each waiting at most for the requests
+// queued ahead of it.
+// 
+// Requires:   sock_path, path of the Unix socket to create
+//             n_workers, no. of worker threads in the pool
+//             rc, result cache shared by the workers, or NULL
+//
+// Returns:    int, non-zero if the socket could not be set up.
+//             Otherwise the server runs until the process is killed.
+//
+// ver. 1.0
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - Unperturbed requests go through the result cache
+// October 19, 2026 - Workers take requests, not connections
+// October 19, 2026 - Requests with non-finite inputs or more levels
+//                    than an int holds are refused
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <cmath>
+   #include <fcntl.h>
+   #include <poll.h>
+   #include <signal.h>
+   #include <sys/socket.h>
+   #include <sys/un.h>
+   #include <deque>
+   #include <vector>
+   #include <thread>
+   #include <mutex>
+   #include <condition_variable>
+
+// Defined in 'parcel_model_r4.cpp'
+   double random_pertubate(double scalar);
+
+// Connections with a request waiting for a free worker, and those a
+// worker has finished with, waiting to be polled again.
+   struct pm_connection_queue {
+      result_cache* rc;
+      std::deque<int> fds;
+      std::vector<int> done;
+      int wake[2];   // pipe, a worker writes to it after adding to 'done'
+      std::mutex lock;
+      std::condition_variable ready;
+   };
+
+
+// --------------------------------------------------------------------
+// Checks a request before any work is done. Returns NULL if the
+// request is usable, otherwise a message for the client.
+// --------------------------------------------------------------------
+
+   const char* pm_validate_request(const pm_request& rq){
+
+      if ( rq.flags != 0 ){ return "unsupported request flags"; }
+      
+      if ( rq.n_trials < 1 || rq.n_trials > PM_MAX_TRIALS ){
+         return "n_trials out of range";
+      }
+      
+      const double in[10] = { rq.pMB, rq.dpMB, rq.ptopMB, rq.TC, rq.qv,
+                              rq.qc, rq.qw, rq.qvs, rq.rh_i, rq.pert };
+      for (int k=0; k < 10; k++){
+         if ( !std::isfinite(in[k]) ){ return "inputs must be finite"; }
+      }
+      
+      if ( !(rq.dpMB > 0) || !(rq.pMB > rq.ptopMB) || !(rq.ptopMB > 0) ){
+         return "pressure grid must satisfy pMB > ptop > 0, dp > 0";
+      }
+      
+// Counted in double, a tiny dp gives more cycles than an int holds.
+      double n_cycles = floor( (rq.pMB-rq.ptopMB)/rq.dpMB );
+      if ( (2 * n_cycles) + 1 > cmax ){
+         return "pressure grid exceeds cmax levels";
+      }
+      
+      return NULL;
+      
+   } // End pm_validate_request
+
+
+// --------------------------------------------------------------------
+// Serves the next request on a connection. Returns 0 if the connection
+// stays open, 1 if it should be closed (hang up, error).
+// --------------------------------------------------------------------
+
+   int pm_serve_request(int fd, result_cache* rc){
+
+      pm_frame_header hdr;
+      pm_request rq;
+      packaged_computations AB;
+
+      if ( pm_recv_header(fd, &hdr) != 0 ){ return 1; }
+      
+      if ( hdr.type != PM_REQUEST || hdr.length != sizeof(rq) ){
+         const char* msg = "malformed request frame";
+         pm_send_frame(fd, PM_ERROR, msg, strlen(msg));
+         return 1;
+      }
+      
+      if ( pm_read_full(fd, &rq, sizeof(rq)) != 0 ){ return 1; }
+      
+      const char* err = pm_validate_request(rq);
+      if ( err != NULL ){
+         return pm_send_frame(fd, PM_ERROR, err, strlen(err)) != 0 ? 1 : 0;
+      }
+
+// Same trial loop as main(), but each profile goes straight back out
+// over the socket instead of into the results file.
+      for (int i=0; i < rq.n_trials; i++){
+      
+         double dT = 0;
+         if ( rq.pert != 0 ){ dT = random_pertubate(rq.pert); }
+      
+         AB = cached_parcel_motion_driver(rq.pert == 0 ? rc : NULL,
+                                   rq.pMB, rq.TC + dT, rq.qv, rq.qc,
+                                   rq.qw, rq.qvs, rq.rh_i, rq.dpMB,
+                                   rq.ptopMB, 0);
+                                   
+         if ( pm_send_profile(fd, i, AB) != 0 ){ return 1; }
+      }
+      
+      return pm_send_frame(fd, PM_DONE, NULL, 0) != 0 ? 1 : 0;
+      
+   } // End pm_serve_request
+
+
+// Worker thread body, answers one request at a time off the queue
+// forever.
+   void pm_worker(pm_connection_queue* Q){
+
+      while ( true ){
+      
+         int fd;
+         {
+            std::unique_lock<std::mutex> guard(Q->lock);
+            while ( Q->fds.empty() ){ Q->ready.wait(guard); }
+            
+            fd = Q->fds.front();
+            Q->fds.pop_front();
+         }
+         
+         if ( pm_serve_request(fd, Q->rc) != 0 ){
+            close(fd);
+            continue;
+         }
+         
+         {
+            std::lock_guard<std::mutex> guard(Q->lock);
+            Q->done.push_back(fd);
+         }
+         char c = 0;
+         if ( write(Q->wake[1], &c, 1) < 0 ){ /* pipe full, already woken */ }
+      }
+      
+   } // End pm_worker
+
+
+// --------------------------------------------------------------------
+
+   int run_parcel_server(const char* sock_path, int n_workers,
+                         result_cache* rc){
+
+// A client that disconnects mid-stream should cost us a failed write,
+// not the whole daemon.
+      signal(SIGPIPE, SIG_IGN);
+
+      struct sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      
+      if ( strlen(sock_path) >= sizeof(addr.sun_path) ){
+         printf("Socket path too long: %s\n", sock_path);
+         return 1;
+      }
+      strcpy(addr.sun_path, sock_path);
+
+      int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if ( lfd < 0 ){
+         perror("socket");
+         return 1;
+      }
+
+// Clear out a stale socket left behind by a previous run.
+      unlink(sock_path);
+      
+      if ( bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+           listen(lfd, 128) != 0 ){
+         perror(sock_path);
+         close(lfd);
+         return 1;
+      }
+
+      if ( n_workers < 1 ){ n_workers = 1; }
+      
+      pm_connection_queue Q;
+      Q.rc = rc;
+      
+      if ( pipe(Q.wake) != 0 ){
+         perror("pipe");
+         close(lfd);
+         return 1;
+      }
+      fcntl(Q.wake[0], F_SETFL, O_NONBLOCK);
+      fcntl(Q.wake[1], F_SETFL, O_NONBLOCK);
+      
+      std::vector<std::thread> pool;
+      
+      for (int i=0; i < n_workers; i++){
+         pool.push_back(std::thread(pm_worker, &Q));
+      }
+
+      printf("> Serving on %s with %d workers\n", sock_path, n_workers);
+      fflush(stdout);
+
+// Poll loop. 'P' holds the listening socket, the wake pipe and every
+// idle connection. A connection with a request waiting leaves 'P' for
+// the queue, and comes back through 'Q.done' once it is answered.
+      std::vector<struct pollfd> P(2);
+      P[0].fd = lfd;        P[0].events = POLLIN;
+      P[1].fd = Q.wake[0];  P[1].events = POLLIN;
+      
+      while ( true ){
+      
+         if ( poll(&P[0], P.size(), -1) < 0 ){
+            if ( errno == EINTR ){ continue; }
+            perror("poll");
+            break;
+         }
+         
+         std::vector<int> ready_fds;
+         
+         for (size_t k=P.size(); k-- > 2; ){
+            if ( P[k].revents != 0 ){
+               ready_fds.push_back(P[k].fd);
+               P.erase(P.begin() + k);
+            }
+         }
+         
+         if ( P[1].revents != 0 ){
+            char buf[256];
+            while ( read(Q.wake[0], buf, sizeof(buf)) > 0 ){}
+            
+            std::lock_guard<std::mutex> guard(Q.lock);
+            for (size_t k=0; k < Q.done.size(); k++){
+               struct pollfd p = { Q.done[k], POLLIN, 0 };
+               P.push_back(p);
+            }
+            Q.done.clear();
+         }
+         
+         if ( P[0].revents != 0 ){
+            int fd = accept(lfd, NULL, NULL);
+            
+            if ( fd < 0 && errno != EINTR && errno != ECONNABORTED ){
+               perror("accept");
+               break;
+            }
+            if ( fd >= 0 ){
+               struct pollfd p = { fd, POLLIN, 0 };
+               P.push_back(p);
+            }
+         }
+         
+         if ( !ready_fds.empty() ){
+            {
+               std::lock_guard<std::mutex> guard(Q.lock);
+               Q.fds.insert(Q.fds.end(), ready_fds.begin(), ready_fds.end());
+            }
+            Q.ready.notify_all();
+         }
+      }
+
+      close(lfd);
+      unlink(sock_path);
+      
+// Workers never return on their own, so don't wait for them.
+      for (size_t i=0; i < pool.size(); i++){ pool[i].detach(); }
+      
+      return 1;
+      
+   } // All done!
@@ -0,0 +1,131 @@
+//
+// parcel_servercheck.cpp
+// Checks for the parcel server and client library, run by 'make check'.
+// Sends requests the server must refuse (non-finite inputs, bad or
+// oversized pressure grids) on one connection, with a good request
+// after each to show the connection is still usable, then checks that
+// the client reads a long ERROR message to its end.
+//
+// To compile:
+// $ make servercheck
+//
+// Usage: p_model_servercheck <socket>
+//
+// Adam Abernathy, adam.abernathy@utah.edu
+// Jeff Fitzgerald, j.fitzgerald@utah.edu
+//
+
+// --------------------------------------------------------------------
+//    Headers & Compiler options
+// --------------------------------------------------------------------
+
+   #include <iostream>
+   #include <stdlib.h>
+   #include <stdio.h>
+   #include <string.h>
+   #include <math.h>
+   #include <string>
+
+   #include "parcel_structs.cpp"
+   #include "parcel_protocol.cpp"
+   #include "parcel_client.cpp"
+
+   using namespace std;
+
+   int sc_n_failed = 0;
+
+   void sc_report(const char* name, bool ok){
+      printf("%-8s%s\n", ok ? "ok" : "FAILED", name);
+      if ( !ok ){ sc_n_failed++; }
+   }
+
+// Keeps the levels of the last profile received
+   void sc_on_profile(int trial, const packaged_computations& AB,
+                      void* ctx){
+      *(int*)ctx = AB.n_steps;
+   }
+
+
+// --------------------------------------------------------------------
+//    MAIN()
+// --------------------------------------------------------------------
+
+   int main(int nbargs, char* args[]) {
+
+   if ( nbargs < 2 ){
+      printf("Usage: %s <socket>\n", args[0]);
+      return 1;
+   }
+
+   int fd = pm_client_connect(args[1]);
+   if ( fd < 0 ){
+      printf("Can't connect to %s\n", args[1]);
+      return 1;
+   }
+
+// Same initial conditions as 'run_parcel_model.csh', unperturbed
+   pm_request good;
+   memset(&good, 0, sizeof(good));
+   good.pMB = 1000.0;
+   good.dpMB = 10.0;
+   good.ptopMB = 500.0;
+   good.TC = 20.0;
+   good.qv = 14.8e-3;
+   good.qw = 14.8e-3;
+   good.rh_i = 0.5;
+   good.n_trials = 1;
+
+   int n_steps = 0;
+   sc_report("server answers a good request",
+             pm_client_run(fd, good, sc_on_profile, &n_steps) == 1 &&
+             n_steps == 101);
+
+// Each of these must come back as an ERROR, and leave the connection
+// in a state where the good request still works.
+   pm_request bad[8];
+   const char* why[8] = { "NaN TC", "infinite qv", "NaN pert",
+                          "dp = 1e-300", "dp = 0", "ptop = pMB",
+                          "too many levels", "n_trials = 0" };
+   for (int k=0; k < 8; k++){ bad[k] = good; }
+   bad[0].TC = NAN;
+   bad[1].qv = INFINITY;
+   bad[2].pert = NAN;
+   bad[3].dpMB = 1.e-300;
+   bad[4].dpMB = 0;
+   bad[5].ptopMB = bad[5].pMB;
+   bad[6].dpMB = 0.1;
+   bad[7].n_trials = 0;
+
+   for (int k=0; k < 8; k++){
+      string name = string("refuses ") + why[k];
+      sc_report(name.c_str(), pm_client_run(fd, bad[k], NULL, NULL) < 0);
+
+      n_steps = 0;
+      name = string("connection usable after ") + why[k];
+      sc_report(name.c_str(),
+                pm_client_run(fd, good, sc_on_profile, &n_steps) == 1 &&
+                n_steps == 101);
+   }
+   close(fd);
+
+// A server error longer than the client's message buffer, then a DONE.
+// The client has to skip the rest of the message to find the DONE.
+   int sv[2];
+   if ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0 ){
+      perror("socketpair");
+      return 1;
+   }
+   string msg(1000, 'x');
+   pm_send_frame(sv[1], PM_ERROR, msg.data(), msg.size());
+   pm_send_frame(sv[1], PM_DONE, NULL, 0);
+
+   sc_report("client reports a long error",
+             pm_client_run(sv[0], good, NULL, NULL) < 0);
+   sc_report("client skips the rest of a long error",
+             pm_client_run(sv[0], good, NULL, NULL) == 0);
+   close(sv[0]);
+   close(sv[1]);
+
+   return sc_n_failed == 0 ? 0 : 1;
+
+   }  //  End main()
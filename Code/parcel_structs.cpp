@@ -0,0 +1,77 @@
+// 
+// parcel_structs.cpp
+// Data structures shared by the parcel model, the parcel server and
+// the client tools. Keeping them in one place means every program
+// agrees on the layout of a computed profile.
+//
+// ver. 1.0
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release, moved out of parcel_model_r4.cpp
+// October 19, 2026 - Templated on the scalar type, the plain names are
+//                    the 'double' versions
+// October 19, 2026 - Added parcel_level_t for the streaming driver
+// October 19, 2026 - Buoyancy, CAPE and CIN against a sounding
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #define cmax 1000     // 'cmax' is the max size of the 
+                         // packaged_computation's arrays.
+
+   template <typename real>
+   struct adjusted_sat_t {
+      real theta; // adj. potential temperature, theta^{n+1} (K)
+      real qv;    // adj. mixing water vapor rat., q_v^{n+1} (kg/kg)
+      real qc;    // adj. mixing liquid water rat., q_c^{n+1} (kg/kg)
+      real qvs;   // sat mixing rat., q_vs^{n+1} (kg/kg),TH1, PBAR
+      real pibar; // Exner function, pi (non-dimensional pressure)
+   }; 
+                     
+   template <typename real>
+   struct packaged_computations_t {
+      real p_mb[cmax];
+      real theta_K[cmax];
+      real T_K[cmax];
+      real qv_gkg[cmax];
+      real qc_gkg[cmax];
+      real rh[cmax];
+      real buoy[cmax];   // buoyancy (m/s^2), 0 without a sounding
+      real cape;         // J/kg, see sounding.cpp
+      real cin;
+      int n_steps;
+   };
+
+// One level of a parcel run, as handed to a streaming driver sink.
+// T and RH are derived from the state on request, so sinks that
+// don't want them never pay for them. Level 0 is the starting point
+// and keeps the inputs as given.
+   template <typename real>
+   struct parcel_level_t {
+      long i;         // level index
+      real p_mb;      // pressure (mb)
+      real theta_K;   // potential temperature (K)
+      real qv_gkg;    // vapor mixing ratio (g/kg)
+      real qc_gkg;    // liquid water mixing ratio (g/kg)
+      real pibar;     // Exner function
+      real qvs;       // saturation mixing ratio (kg/kg)
+      real T_start;   // initial temperature (K)
+      real rh_start;  // initial relative humidity
+      real buoy;      // buoyancy (m/s^2), 0 without a sounding
+      real cape;      // CAPE and CIN (J/kg) of the ascent so far
+      real cin;
+
+      real T_K() const { return i == 0 ? T_start : theta_K * pibar; }
+      real rh() const { return i == 0 ? rh_start : qv_gkg / (qvs*1.e3); }
+   };
+
+   typedef adjusted_sat_t<double> adjusted_sat;
+   typedef packaged_computations_t<double> packaged_computations;
+   typedef parcel_level_t<double> parcel_level;
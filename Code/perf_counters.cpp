@@ -0,0 +1,283 @@
+//
+// perf_counters.cpp
+// Hardware performance counters for the profiling mode (--profile,
+// see parcel_profile.cpp). Each thread opens its own set of counters
+// with perf_event_open, counting only that thread in user space:
+//    cycles, instructions, cache misses, branch mispredictions
+// Counters the kernel or the machine does not provide (containers,
+// VMs, perf_event_paranoid) are simply left out of the report, the
+// thread CPU time is always there.
+//
+// Also holds the satadjust probe. With 'satadjust_probe' set, every
+// call of compute_satadjust on this thread records how many passes of
+// its while loop it took and how many of them took the qc1 < 0 branch,
+// and optionally its inputs so the calls can be replayed in isolation.
+//
+// ver. 1.0
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <stdint.h>
+   #include <unistd.h>
+   #include <errno.h>
+   #include <time.h>
+   #include <vector>
+   #include <sys/syscall.h>
+   #include <sys/ioctl.h>
+   #include <linux/perf_event.h>
+
+   enum pc_event {
+      PC_CYCLES       = 0,
+      PC_INSTRUCTIONS = 1,
+      PC_CACHE_MISSES = 2,
+      PC_BRANCH_MISSES = 3,
+      PC_N_EVENTS     = 4
+   };
+
+   const uint64_t pc_event_config[PC_N_EVENTS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+   struct pc_counters {
+      int fd[PC_N_EVENTS];   // -1 where the event is not available
+      int avail;             // bit e set when event e is counting
+   };
+
+   struct pc_sample {
+      double v[PC_N_EVENTS];
+      double ns;             // thread CPU time
+   };
+
+// Totals for one phase of the run, 'calls' is what they are divided
+// by in the report (parcel-steps, kernel calls).
+   struct pc_phase {
+      const char* name;
+      const char* per;
+      uint64_t calls;
+      pc_sample total;
+      int avail;
+   };
+
+
+// --------------------------------------------------------------------
+// Counters
+// --------------------------------------------------------------------
+
+// Opens the counters for the calling thread. Returns the number of
+// hardware events available, 0 means time only.
+   int pc_open(pc_counters* pc){
+
+      pc->avail = 0;
+      int n = 0;
+
+      for (int e=0; e < PC_N_EVENTS; e++){
+
+         struct perf_event_attr attr;
+         memset(&attr, 0, sizeof(attr));
+         attr.size = sizeof(attr);
+         attr.type = PERF_TYPE_HARDWARE;
+         attr.config = pc_event_config[e];
+         attr.exclude_kernel = 1;
+         attr.exclude_hv = 1;
+         attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                            PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+         pc->fd[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+         if ( pc->fd[e] >= 0 ){
+            pc->avail |= 1 << e;
+            n++;
+         }
+      }
+
+      return n;
+
+   } // End pc_open
+
+
+   void pc_close(pc_counters* pc){
+      for (int e=0; e < PC_N_EVENTS; e++){
+         if ( pc->fd[e] >= 0 ){ close(pc->fd[e]); }
+         pc->fd[e] = -1;
+      }
+      pc->avail = 0;
+   }
+
+
+// Current counts. When the PMU has fewer counters than we ask for the
+// kernel time-slices them, the counts are scaled up to the full time.
+   void pc_read(const pc_counters* pc, pc_sample* s){
+
+      for (int e=0; e < PC_N_EVENTS; e++){
+
+         uint64_t buf[3];  // value, time enabled, time running
+         s->v[e] = 0;
+
+         if ( pc->fd[e] >= 0 &&
+              read(pc->fd[e], buf, sizeof(buf)) == sizeof(buf) ){
+            s->v[e] = buf[2] > 0 ? (double)buf[0] * buf[1] / buf[2] : 0;
+         }
+      }
+
+      struct timespec ts;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      s->ns = ts.tv_sec * 1.e9 + ts.tv_nsec;
+
+   } // End pc_read
+
+
+   void pc_phase_init(pc_phase* ph, const char* name, const char* per,
+                      int avail){
+      memset(ph, 0, sizeof(*ph));
+      ph->name = name;
+      ph->per = per;
+      ph->avail = avail;
+   }
+
+// Adds the counts between samples 'a' and 'b' to the phase.
+   void pc_phase_add(pc_phase* ph, const pc_sample& a, const pc_sample& b,
+                     uint64_t calls){
+      for (int e=0; e < PC_N_EVENTS; e++){
+         ph->total.v[e] += b.v[e] - a.v[e];
+      }
+      ph->total.ns += b.ns - a.ns;
+      ph->calls += calls;
+   }
+
+   void pc_phase_merge(pc_phase* into, const pc_phase& from){
+      for (int e=0; e < PC_N_EVENTS; e++){
+         into->total.v[e] += from.total.v[e];
+      }
+      into->total.ns += from.total.ns;
+      into->calls += from.calls;
+      into->avail &= from.avail;
+   }
+
+
+// --------------------------------------------------------------------
+// Report
+// --------------------------------------------------------------------
+
+   void pc_print_phase_header(){
+      printf("   %-18s %-5s %10s %10s %10s %6s %10s %10s\n", "phase", "per",
+             "count", "cycles", "instr", "IPC", "cache-miss", "br-miss");
+   }
+
+// One line per phase, counts per call. Events that were not
+// available print as 'n/a'.
+   void pc_print_phase(const pc_phase& ph){
+
+      if ( ph.calls == 0 ){ return; }
+
+      double n = (double)ph.calls;
+      char col[PC_N_EVENTS][16];
+
+      for (int e=0; e < PC_N_EVENTS; e++){
+         if ( ph.avail & (1 << e) ){
+            snprintf(col[e], 16, "%.2f", ph.total.v[e] / n);
+         }else{
+            snprintf(col[e], 16, "n/a");
+         }
+      }
+
+      char ipc[16] = "n/a";
+      if ( (ph.avail & 3) == 3 && ph.total.v[PC_CYCLES] > 0 ){
+         snprintf(ipc, 16, "%.2f",
+                  ph.total.v[PC_INSTRUCTIONS] / ph.total.v[PC_CYCLES]);
+      }
+
+      printf("   %-18s %-5s %10llu %10s %10s %6s %10s %10s   %.1f ns\n",
+             ph.name, ph.per, (unsigned long long)ph.calls,
+             col[PC_CYCLES], col[PC_INSTRUCTIONS], ipc,
+             col[PC_CACHE_MISSES], col[PC_BRANCH_MISSES], ph.total.ns / n);
+
+   } // End pc_print_phase
+
+
+// --------------------------------------------------------------------
+// satadjust probe
+// --------------------------------------------------------------------
+
+   #define SA_ITT_MAX 10   // matches 'ittmax' in satadjust.cpp
+
+// One recorded call, enough to call it again.
+   struct sa_probe_call {
+      double theta, qv, qc, pbar;
+      int itt;      // passes through the while loop
+      int n_dry;    // passes that took the qc1 < 0 branch
+   };
+
+   struct satadjust_probe_t {
+      uint64_t calls;
+      uint64_t iterations;
+      uint64_t dry_iterations;  // qc1 < 0 taken
+      uint64_t dry_calls;       // calls taking it at least once
+      uint64_t itt_hist[SA_ITT_MAX + 1];
+      std::vector<sa_probe_call>* capture;  // NULL = counts only
+      size_t capture_max;
+   };
+
+   thread_local satadjust_probe_t* satadjust_probe = NULL;
+
+
+   void sa_probe_init(satadjust_probe_t* p){
+      memset(p, 0, sizeof(*p));
+   }
+
+   void sa_probe_record(satadjust_probe_t* p, double theta, double qv,
+                        double qc, double pbar, int itt, int n_dry){
+
+      p->calls++;
+      p->iterations += itt;
+      p->dry_iterations += n_dry;
+      p->dry_calls += n_dry > 0;
+      p->itt_hist[itt < SA_ITT_MAX ? itt : SA_ITT_MAX]++;
+
+      if ( p->capture != NULL && p->capture->size() < p->capture_max ){
+         sa_probe_call c = { theta, qv, qc, pbar, itt, n_dry };
+         p->capture->push_back(c);
+      }
+
+   } // End sa_probe_record
+
+
+   void sa_probe_merge(satadjust_probe_t* into, const satadjust_probe_t& from){
+      into->calls += from.calls;
+      into->iterations += from.iterations;
+      into->dry_iterations += from.dry_iterations;
+      into->dry_calls += from.dry_calls;
+      for (int k=0; k <= SA_ITT_MAX; k++){
+         into->itt_hist[k] += from.itt_hist[k];
+      }
+   }
+
+   void sa_probe_print(const satadjust_probe_t& p){
+
+      if ( p.calls == 0 ){ return; }
+
+      printf("   satadjust loop: %.3f passes per call, qc1 < 0 taken in "
+             "%.1f%% of passes (%.1f%% of calls)\n",
+             (double)p.iterations / p.calls,
+             100. * p.dry_iterations / (p.iterations > 0 ? p.iterations : 1),
+             100. * p.dry_calls / p.calls);
+
+      printf("   passes per call:");
+      for (int k=1; k <= SA_ITT_MAX; k++){
+         if ( p.itt_hist[k] > 0 ){
+            printf("  %d: %.1f%%", k, 100. * p.itt_hist[k] / p.calls);
+         }
+      }
+      printf("\n");
+
+   } // End sa_probe_print
@@ -0,0 +1,156 @@
+//
+// pmz_decode.cpp
+// Decoder for compressed results files (.pmz, see pmz_codec.cpp).
+// Writes the same text 'results.txt' the model would have written,
+// decoding blocks on several threads, or prints a single trial using
+// the block index.
+//
+// To compile:
+// $ make pmz
+//
+// Usage: p_model_pmz <file.pmz> [results.txt] [--threads n]
+//        p_model_pmz <file.pmz> --trial <t>
+//
+// Adam Abernathy, adam.abernathy@utah.edu
+// Jeff Fitzgerald, j.fitzgerald@utah.edu
+//
+
+// --------------------------------------------------------------------
+//    Headers & Compiler options
+// --------------------------------------------------------------------
+
+   #include <fstream>
+   #include <iostream>
+   #include <sstream>
+   #include <stdlib.h>
+   #include <stdio.h>
+   #include <string.h>
+   #include <string>
+   #include <vector>
+   #include <thread>
+
+   #include "write_output.cpp"
+   #include "pmz_codec.cpp"
+
+   using namespace std;
+
+
+// Decodes block 'b' to text. Empty string if the block is damaged.
+   void decode_block_text(const pmz_reader* r, size_t b, string* text){
+
+      vector<double> cols[PMZ_N_COLS];
+      
+      if ( pmz_read_block(r, b, cols) != 0 ){
+         text->clear();
+         return;
+      }
+      
+      ostringstream out;
+      for (size_t i=0; i < cols[0].size(); i++){
+         write_output_row(out, cols[0][i], cols[1][i], cols[2][i],
+                          cols[3][i], cols[4][i]);
+      }
+      *text = out.str();
+      
+   } // End decode_block_text
+
+
+// --------------------------------------------------------------------
+//    MAIN()
+// --------------------------------------------------------------------
+
+   int main(int nbargs, char* args[]) {
+
+   const char* in_name = NULL;
+   const char* out_name = "results.txt";
+   int n_threads = thread::hardware_concurrency();
+   long trial = -1;
+
+   for (int a = 1; a < nbargs; a++){
+      if ( strcmp(args[a],"--threads") == 0 && a+1 < nbargs ){
+         n_threads = atoi(args[++a]);
+      }else if ( strcmp(args[a],"--trial") == 0 && a+1 < nbargs ){
+         trial = atol(args[++a]);
+      }else if ( in_name == NULL ){
+         in_name = args[a];
+      }else{
+         out_name = args[a];
+      }
+   }
+   
+   if ( in_name == NULL ){
+      printf("Usage: %s <file.pmz> [results.txt] [--threads n]\n", args[0]);
+      printf("       %s <file.pmz> --trial <t>\n", args[0]);
+      return 1;
+   }
+   if ( n_threads < 1 ){ n_threads = 1; }
+
+   pmz_reader* r = pmz_open_read(in_name);
+   if ( r == NULL ){ return 1; }
+
+// Single trial, straight from the index
+   if ( trial >= 0 ){
+   
+      vector<double> cols[PMZ_N_COLS];
+      
+      if ( pmz_read_trial(r, trial, cols) != 0 ){
+         printf("Trial %ld is not in %s\n", trial, in_name);
+         pmz_close_read(r);
+         return 1;
+      }
+      
+      write_output_header(cout);
+      for (size_t i=0; i < cols[0].size(); i++){
+         write_output_row(cout, cols[0][i], cols[1][i], cols[2][i],
+                          cols[3][i], cols[4][i]);
+      }
+      
+      pmz_close_read(r);
+      return 0;
+   }
+
+// Whole file. Blocks are decoded a batch at a time, one thread per
+// block, and written out in order.
+   ofstream results_file(out_name, ios::out | ios::binary);
+   if ( !results_file.is_open() ){
+      cout << "File I/O Error! Check Output file.";
+      pmz_close_read(r);
+      return 1;
+   }
+   
+   write_output_header(results_file);
+   
+   size_t n_blocks = r->index.size();
+   int status = 0;
+   
+   for (size_t b0=0; b0 < n_blocks && status == 0; b0 += n_threads){
+   
+      size_t n = n_blocks - b0 < (size_t)n_threads ? n_blocks - b0 : n_threads;
+      vector<string> text(n);
+      vector<thread> pool;
+      
+      for (size_t j=0; j < n; j++){
+         pool.push_back(thread(decode_block_text, r, b0 + j, &text[j]));
+      }
+      
+      for (size_t j=0; j < n; j++){
+         pool[j].join();
+         
+         if ( text[j].empty() ){
+            printf("Block %zu of %s is damaged\n", b0 + j, in_name);
+            status = 1;
+         }
+         results_file << text[j];
+      }
+   }
+   
+   results_file.close();
+   
+   printf("Decoded %llu rows in %zu blocks to %s\n", 
+          (unsigned long long)r->n_rows, n_blocks, out_name);
+          
+   pmz_close_read(r);
+   
+   return status;
+   
+   }  //  End main()
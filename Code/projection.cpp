@@ -0,0 +1,231 @@
+//
+// projection.cpp
+// Output projection. By default every level of every trial goes to
+// 'results.txt' with P, T, TH, QV and QC. A projection picks which
+// variables (--vars) and which levels (--levels, --level-stride) are
+// wanted, and the rest is never formatted or written. With the
+// streaming driver nothing else is stored either: the projecting
+// sink only asks a level for T or RH when they are wanted, so
+// unwanted ones are never computed.
+//
+//    --vars qc,p             any of P, T, TH, QV, QC, RH, B (in
+//                            any case), written in that order
+//    --levels 850,700,500    the levels nearest these pressures (mb),
+//                            on the way up and on the way down
+//    --level-stride n        every n-th level of the dp grid, counting
+//                            from the first, on the way up and down
+// Levels kept must pass both, either one alone leaves the other open.
+// A --levels pressure outside the run's grid [ptop, p] is an error.
+// B (buoyancy) needs a sounding, see sounding.cpp.
+//
+// The kept levels are worked out once for the run's dp grid, so the
+// check per level is a table read.
+//
+// ver. 1.0
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <string>
+   #include <vector>
+
+   enum out_var {
+      OUT_P  = 0,
+      OUT_T  = 1,
+      OUT_TH = 2,
+      OUT_QV = 3,
+      OUT_QC = 4,
+      OUT_RH = 5,
+      OUT_B  = 6,
+      OUT_N_VARS = 7
+   };
+
+   const char* out_var_names[OUT_N_VARS] = { "P_MB", "T", "TH", "QV", "QC",
+                                             "RH", "B" };
+
+// What results.txt holds without a projection
+   #define OUT_DEFAULT_VARS ((1u<<OUT_P) | (1u<<OUT_T) | (1u<<OUT_TH) | \
+                             (1u<<OUT_QV) | (1u<<OUT_QC))
+
+   struct out_projection {
+      unsigned vars;              // bit per out_var
+      long stride;                // keep every stride-th level
+      std::vector<double> p_mb;   // keep levels nearest these, empty = all
+      std::string spec;           // as given, for checkpoints
+
+// Built by proj_build for one run, per level j = 0 .. n_cycles
+      long n_cycles;
+      long n_steps;
+      std::vector<char> mark;
+   };
+
+
+// "qc,p" and the like. Returns 0 on success.
+   int proj_parse_vars(const char* s, unsigned* vars){
+
+      *vars = 0;
+      std::string list = s;
+      size_t a = 0;
+
+      while ( a <= list.size() ){
+         size_t b = list.find(',', a);
+         if ( b == std::string::npos ){ b = list.size(); }
+         std::string name = list.substr(a, b - a);
+         for (size_t c=0; c < name.size(); c++){ name[c] = toupper(name[c]); }
+         if ( name == "P" ){ name = "P_MB"; }
+
+         int v = -1;
+         for (int k=0; k < OUT_N_VARS; k++){
+            if ( name == out_var_names[k] ){ v = k; }
+         }
+         if ( v < 0 ){
+            printf("Unknown output variable '%s', want any of "
+                   "P, T, TH, QV, QC, RH, B\n", name.c_str());
+            return 1;
+         }
+         *vars |= 1u << v;
+         a = b + 1;
+      }
+
+      return 0;
+
+   } // End proj_parse_vars
+
+
+// "850,700,500", pressures in mb. Returns 0 on success.
+   int proj_parse_levels(const char* s, std::vector<double>* p_mb){
+
+      p_mb->clear();
+      const char* c = s;
+
+      while ( *c != 0 ){
+         char* end;
+         double p = strtod(c, &end);
+         if ( end == c || !(p > 0) || (*end != ',' && *end != 0) ){
+            printf("Bad level list '%s', want pressures in mb "
+                   "like 850,700,500\n", s);
+            return 1;
+         }
+         p_mb->push_back(p);
+         c = *end == ',' ? end + 1 : end;
+      }
+
+      return 0;
+
+   } // End proj_parse_levels
+
+
+// Marks the levels to keep on the grid of a run. Returns 0 on success.
+   int proj_build(out_projection* P, double pMB, double dpMB,
+                  double ptopMB){
+
+      P->n_cycles = (long)((pMB-ptopMB)/dpMB);
+      P->n_steps = 2 * P->n_cycles + 1;
+      P->mark.assign(P->n_cycles + 1, P->p_mb.empty() ? 1 : 0);
+
+      for (size_t k=0; k < P->p_mb.size(); k++){
+         long j = lround((pMB - P->p_mb[k]) / dpMB);
+         if ( j < 0 || j > P->n_cycles ){
+            printf("--levels %g mb is outside the run, which goes from "
+                   "%g to %g mb\n", P->p_mb[k], pMB,
+                   pMB - P->n_cycles * dpMB);
+            return 1;
+         }
+         P->mark[j] = 1;
+      }
+
+      return 0;
+
+   } // End proj_build
+
+
+// Is level i (0 .. n_steps-1) of the run wanted? The way down visits
+// grid levels j in reverse, the stride counts on j so both ways keep
+// the same pressures.
+   inline bool proj_keep(const out_projection& P, long i){
+      long j = i <= P.n_cycles ? i : P.n_steps - 1 - i;
+      if ( j % P.stride != 0 ){ return false; }
+      return P.mark[j] != 0;
+   }
+
+
+   void proj_write_header(std::ostream& out, const out_projection& P){
+      const char* sep = "# ";
+      for (int k=0; k < OUT_N_VARS; k++){
+         if ( P.vars & (1u<<k) ){
+            out << sep << out_var_names[k];
+            sep = ", ";
+         }
+      }
+      out << std::endl;
+   }
+
+// One row from the wanted values in 'v', same formatting as
+// write_output_row().
+   void proj_write_row(std::ostream& out, const out_projection& P,
+                       const double v[OUT_N_VARS]){
+      char delim = 0;
+      for (int k=0; k < OUT_N_VARS; k++){
+         if ( P.vars & (1u<<k) ){
+            if ( delim != 0 ){ out << delim; }
+            out << v[k];
+            delim = ',';
+         }
+      }
+      out << std::endl;
+   }
+
+
+// Streaming writer for a projected run. Only the wanted levels are
+// looked at, and only the wanted values taken from them.
+   struct projecting_sink {
+      std::ostream* out;
+      const out_projection* P;
+      double cape, cin;   // of the run so far
+
+      void operator()(const parcel_level& L){
+         cape = L.cape;
+         cin = L.cin;
+
+         if ( !proj_keep(*P, L.i) ){ return; }
+
+         unsigned w = P->vars;
+         double v[OUT_N_VARS];
+         if ( w & (1u<<OUT_P) ){  v[OUT_P] = L.p_mb; }
+         if ( w & (1u<<OUT_T) ){  v[OUT_T] = L.T_K(); }
+         if ( w & (1u<<OUT_TH) ){ v[OUT_TH] = L.theta_K; }
+         if ( w & (1u<<OUT_QV) ){ v[OUT_QV] = L.qv_gkg; }
+         if ( w & (1u<<OUT_QC) ){ v[OUT_QC] = L.qc_gkg; }
+         if ( w & (1u<<OUT_RH) ){ v[OUT_RH] = L.rh(); }
+         if ( w & (1u<<OUT_B) ){  v[OUT_B] = L.buoy; }
+
+         proj_write_row(*out, *P, v);
+      }
+   };
+
+
+// The same from a packaged run, for results that come out of the
+// result cache.
+   void proj_write_packaged(std::ostream& out, const out_projection& P,
+                            const packaged_computations& AB){
+
+      for (int i=0; i < AB.n_steps; i++){
+         if ( !proj_keep(P, i) ){ continue; }
+
+         double v[OUT_N_VARS] = { AB.p_mb[i], AB.T_K[i], AB.theta_K[i],
+                                  AB.qv_gkg[i], AB.qc_gkg[i], AB.rh[i],
+                                  AB.buoy[i] };
+         proj_write_row(out, P, v);
+      }
+
+   } // End proj_write_packaged
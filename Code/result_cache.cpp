@@ -0,0 +1,520 @@
+// 
+// result_cache.cpp
+// Content addressed cache of driver results. Unperturbed runs are
+// deterministic, so a profile can be reused whenever the same initial
+// conditions come around again.
+//
+// Entries are keyed on a hash of the canonicalized inputs together with
+// RC_CODE_VERSION. There are two tiers,
+//
+//    memory   LRU list, capped at 'mem_mb'
+//    disk     memory mapped file of fixed size slots, capped at
+//             'disk_mb'. Slot = hash % n_slots, a newer entry simply
+//             replaces whatever was there.
+//
+// Both tiers store the full key next to the profile and compare it on
+// lookup: the inputs, the saturation phase and a digest of the
+// sounding. So a hash collision is a miss, never a wrong answer. 'qw'
+// and 'qvs' never reach the returned profile, so they are left out of
+// the key. The disk file is safe to share between threads of one
+// process but assumes a single writing process.
+//
+// Entries hold only the profile's n_steps rows. Disk slots are sized
+// for the longest profile of the run that created the file, longer
+// ones are kept in memory only.
+//
+// A disk slot is cleared, filled, then marked valid again, with the
+// flag written atomically and ordered against the entry. Each slot
+// also holds a checksum of its entry, so a slot torn by a crash (the
+// kernel may write the pages of a mapping back in any order) reads as
+// a miss.
+//
+// Requires: parcel_structs.cpp, sounding.cpp (for snd_for_run),
+//           compute_esat_ice.cpp (for sat_phase)
+//
+// ver. 1.2
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - Mixed-phase and sounding runs get their own keys
+// October 19, 2026 - Atomic slot flag and entry checksum, cache 2
+// October 19, 2026 - Phase and sounding in the stored key, entries
+//                    sized to the profile, cache 3
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <stddef.h>
+   #include <stdint.h>
+   #include <fcntl.h>
+   #include <unistd.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <list>
+   #include <unordered_map>
+   #include <vector>
+   #include <mutex>
+
+// Bump this whenever the physics changes, it invalidates every entry
+// written by an older build.
+   #define RC_CODE_VERSION "parcel_model_r4 build 2, cache 3"
+
+   #define RC_MAGIC      0x31434D50  // "PMC1"
+   #define RC_N_INPUTS   7           // pMB, dpMB, ptopMB, TC, qv, qc, rh_i
+   #define RC_N_COLUMNS  7           // p, theta, T, qv, qc, rh, buoy
+
+// Everything that decides a profile. Compared whole on lookup, the
+// hash only picks where to look.
+   struct rc_key {
+      uint64_t hash;
+      double inputs[RC_N_INPUTS];
+      uint64_t sat_phase;
+      uint64_t sounding;     // digest of the sounding, 0 for none
+   };
+
+// A cached profile, only its n_steps rows, column by column.
+   struct rc_entry {
+      rc_key K;
+      double cape, cin;
+      int64_t n_steps;
+      std::vector<double> cols;   // RC_N_COLUMNS x n_steps
+   };
+
+// On disk layout, a header followed by 'n_slots' slots of 'slot_size'
+// bytes. A slot is an rc_disk_slot followed by room for RC_N_COLUMNS
+// columns of 'slot_levels' rows.
+   struct rc_disk_header {
+      uint32_t magic;
+      uint32_t slot_size;
+      uint64_t n_slots;
+      uint64_t version_hash;
+      uint64_t slot_levels;
+   };
+
+   struct rc_disk_slot {
+      uint64_t valid;    // only through __atomic loads and stores
+      uint64_t check;    // rc_slot_check of the rest of the slot
+      rc_key K;
+      double cape, cin;
+      int64_t n_steps;
+   };
+
+   struct result_cache {
+      std::mutex lock;
+
+// memory tier, most recently used at the front
+      std::list<rc_entry> lru;
+      std::unordered_map<uint64_t, std::list<rc_entry>::iterator> index;
+      size_t mem_capacity;   // bytes
+      size_t mem_bytes;
+
+// disk tier
+      int fd;
+      size_t map_bytes;
+      rc_disk_header* hdr;
+      char* slots;
+
+// statistics
+      long hits_mem, hits_disk, misses, stores, evictions;
+   };
+
+
+// --------------------------------------------------------------------
+// FNV-1a, plenty for a cache key, and the inputs are verified anyway.
+// --------------------------------------------------------------------
+
+   uint64_t rc_fnv1a(const void* data, size_t n, uint64_t h){
+
+      const unsigned char* p = (const unsigned char*)data;
+      
+      for (size_t i=0; i < n; i++){
+         h ^= p[i];
+         h *= 1099511628211ULL;
+      }
+      
+      return h;
+      
+   } // End rc_fnv1a
+
+
+// Checksum of a filled slot, its key and profile, a word at a time so
+// it costs little next to the copy.
+   uint64_t rc_slot_check(const rc_disk_slot* S){
+
+      const uint64_t* w = (const uint64_t*)&S->K;
+      size_t n = (sizeof(rc_disk_slot) - offsetof(rc_disk_slot, K)) / 8;
+      if ( S->n_steps >= 0 && S->n_steps <= cmax ){
+         n += RC_N_COLUMNS * S->n_steps;
+      }
+      
+      uint64_t h = 14695981039346656037ULL;
+      for (size_t i=0; i < n; i++){
+         h = (h ^ w[i]) * 1099511628211ULL;
+      }
+      
+      return h;
+      
+   } // End rc_slot_check
+
+
+// Fills 'K' with the canonical form of the inputs and returns the key.
+// Returns 0 (never a valid key) if the inputs can't be cached.
+   uint64_t rc_make_key(double pMB, double dpMB, double ptopMB, double TC,
+                        double qv, double qc, double rh_i, rc_key* K){
+
+      double* in = K->inputs;
+      in[0] = pMB;  in[1] = dpMB; in[2] = ptopMB; in[3] = TC;
+      in[4] = qv;   in[5] = qc;   in[6] = rh_i;
+
+// -0 and +0 give the same run, NaN never matches itself.
+      for (int i=0; i < RC_N_INPUTS; i++){
+         if ( in[i] != in[i] ){ return 0; }
+         if ( in[i] == 0 ){ in[i] = 0.0; }
+      }
+      
+      uint64_t h = 14695981039346656037ULL;
+      h = rc_fnv1a(RC_CODE_VERSION, strlen(RC_CODE_VERSION), h);
+      h = rc_fnv1a(in, sizeof(double)*RC_N_INPUTS, h);
+      
+// Mixed-phase runs are a different model.
+      K->sat_phase = sat_phase;
+      if ( sat_phase != SAT_PHASE_LIQUID ){
+         h = rc_fnv1a(&sat_phase, sizeof(sat_phase), h);
+      }
+      
+// So are runs against a sounding, which also carry its buoyancy.
+      K->sounding = 0;
+      const snd_index* E = snd_for_run(pMB, dpMB, ptopMB);
+      if ( E != NULL ){
+         size_t n = E->S.p_mb.size() * sizeof(double);
+         uint64_t d = 14695981039346656037ULL;
+         d = rc_fnv1a(&E->S.p_mb[0], n, d);
+         d = rc_fnv1a(&E->S.T_K[0], n, d);
+         d = rc_fnv1a(&E->S.qv[0], n, d);
+         K->sounding = d == 0 ? 1 : d;
+         h = rc_fnv1a(&K->sounding, sizeof(K->sounding), h);
+      }
+      
+      K->hash = h == 0 ? 1 : h;
+      return K->hash;
+      
+   } // End rc_make_key
+
+
+// The n_steps rows of a profile to and from columns laid end to end.
+   void rc_pack(const packaged_computations& AB, double* cols){
+      const double* src[RC_N_COLUMNS] = { AB.p_mb, AB.theta_K, AB.T_K,
+                                          AB.qv_gkg, AB.qc_gkg, AB.rh,
+                                          AB.buoy };
+      for (int c=0; c < RC_N_COLUMNS; c++){
+         memcpy(cols + c * AB.n_steps, src[c], AB.n_steps * sizeof(double));
+      }
+   }
+
+   void rc_unpack(const double* cols, long n_steps, double cape, double cin,
+                  packaged_computations* AB){
+      double* dst[RC_N_COLUMNS] = { AB->p_mb, AB->theta_K, AB->T_K,
+                                    AB->qv_gkg, AB->qc_gkg, AB->rh,
+                                    AB->buoy };
+      for (int c=0; c < RC_N_COLUMNS; c++){
+         memcpy(dst[c], cols + c * n_steps, n_steps * sizeof(double));
+      }
+      AB->n_steps = n_steps;
+      AB->cape = cape;
+      AB->cin = cin;
+   }
+
+
+// --------------------------------------------------------------------
+// Open / close. 'slot_levels' is the longest profile a disk slot has
+// to hold. An existing file with the same code version and slots at
+// least that long is kept as it is, otherwise it is started over.
+// --------------------------------------------------------------------
+
+   result_cache* rc_open(const char* path, double mem_mb, double disk_mb,
+                         long slot_levels){
+
+      result_cache* rc = new result_cache;
+      
+      rc->mem_capacity = (size_t)(mem_mb * 1048576.0);
+      rc->mem_bytes = 0;
+      rc->fd = -1;
+      rc->map_bytes = 0;
+      rc->hdr = NULL;
+      rc->slots = NULL;
+      rc->hits_mem = rc->hits_disk = rc->misses = 0;
+      rc->stores = rc->evictions = 0;
+
+      if ( slot_levels < 1 || slot_levels > cmax ){ slot_levels = cmax; }
+      size_t slot_size = sizeof(rc_disk_slot) + 
+                         RC_N_COLUMNS * slot_levels * sizeof(double);
+      size_t n_slots = (size_t)(disk_mb * 1048576.0 / slot_size);
+      
+      if ( path == NULL || n_slots == 0 ){ return rc; }
+
+      uint64_t version_hash = rc_fnv1a(RC_CODE_VERSION, 
+                                       strlen(RC_CODE_VERSION),
+                                       14695981039346656037ULL);
+
+      int fd = open(path, O_RDWR | O_CREAT, 0644);
+      if ( fd < 0 ){
+         perror(path);
+         return rc;
+      }
+
+// An existing file is reused with its own geometry if its slots are
+// long enough for this run, so runs on finer grids don't wipe it.
+      rc_disk_header old;
+      struct stat st;
+      bool reuse = fstat(fd, &st) == 0 && 
+                   pread(fd, &old, sizeof(old), 0) == sizeof(old) &&
+                   old.magic == RC_MAGIC && 
+                   old.version_hash == version_hash &&
+                   old.slot_levels >= (uint64_t)slot_levels &&
+                   old.slot_levels <= (uint64_t)cmax &&
+                   old.slot_size == sizeof(rc_disk_slot) + 
+                      RC_N_COLUMNS * old.slot_levels * sizeof(double) &&
+                   old.n_slots > 0 &&
+                   (size_t)st.st_size == sizeof(rc_disk_header) + 
+                                         old.n_slots * old.slot_size;
+      
+      if ( reuse ){
+         slot_levels = old.slot_levels;
+         slot_size = old.slot_size;
+         n_slots = old.n_slots;
+      }
+      
+      size_t bytes = sizeof(rc_disk_header) + n_slots * slot_size;
+                   
+      if ( !reuse ){
+         if ( ftruncate(fd, 0) != 0 || ftruncate(fd, bytes) != 0 ){
+            perror(path);
+            close(fd);
+            return rc;
+         }
+      }
+      
+      void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+      if ( map == MAP_FAILED ){
+         perror(path);
+         close(fd);
+         return rc;
+      }
+      
+      rc->fd = fd;
+      rc->map_bytes = bytes;
+      rc->hdr = (rc_disk_header*)map;
+      rc->slots = (char*)map + sizeof(rc_disk_header);
+      
+      if ( !reuse ){
+         rc->hdr->magic = RC_MAGIC;
+         rc->hdr->slot_size = slot_size;
+         rc->hdr->n_slots = n_slots;
+         rc->hdr->version_hash = version_hash;
+         rc->hdr->slot_levels = slot_levels;
+      }
+      
+      return rc;
+      
+   } // End rc_open
+
+
+   void rc_close(result_cache* rc){
+
+      if ( rc == NULL ){ return; }
+      
+      if ( rc->hdr != NULL ){
+         munmap(rc->hdr, rc->map_bytes);
+         close(rc->fd);
+      }
+      
+      delete rc;
+      
+   } // End rc_close
+
+
+// --------------------------------------------------------------------
+// Memory tier helpers, caller holds the lock.
+// --------------------------------------------------------------------
+
+   size_t rc_entry_bytes(const rc_entry& E){
+      return sizeof(rc_entry) + E.cols.size() * sizeof(double);
+   }
+
+   void rc_mem_insert(result_cache* rc, const rc_entry& E){
+
+      size_t need = rc_entry_bytes(E);
+      if ( need > rc->mem_capacity ){ return; }
+      
+      auto it = rc->index.find(E.K.hash);
+      if ( it != rc->index.end() ){
+         rc->mem_bytes -= rc_entry_bytes(*it->second);
+         rc->lru.erase(it->second);
+         rc->index.erase(it);
+      }
+      
+      while ( rc->mem_bytes + need > rc->mem_capacity ){
+         rc->mem_bytes -= rc_entry_bytes(rc->lru.back());
+         rc->index.erase(rc->lru.back().K.hash);
+         rc->lru.pop_back();
+         rc->evictions++;
+      }
+      
+      rc->lru.push_front(E);
+      rc->index[E.K.hash] = rc->lru.begin();
+      rc->mem_bytes += need;
+      
+   } // End rc_mem_insert
+
+
+   bool rc_same_key(const rc_key& a, const rc_key& b){
+      return memcmp(&a, &b, sizeof(rc_key)) == 0;
+   }
+
+   rc_disk_slot* rc_disk_slot_for(result_cache* rc, uint64_t h){
+      return (rc_disk_slot*)(rc->slots + 
+                             (h % rc->hdr->n_slots) * rc->hdr->slot_size);
+   }
+
+
+// --------------------------------------------------------------------
+// Lookup and store
+// --------------------------------------------------------------------
+
+   bool rc_lookup(result_cache* rc, const rc_key& K,
+                  packaged_computations* out){
+
+      std::lock_guard<std::mutex> guard(rc->lock);
+
+      auto it = rc->index.find(K.hash);
+      if ( it != rc->index.end() && rc_same_key(it->second->K, K) ){
+         rc_entry& E = *it->second;
+         rc->lru.splice(rc->lru.begin(), rc->lru, it->second);
+         rc_unpack(&E.cols[0], E.n_steps, E.cape, E.cin, out);
+         rc->hits_mem++;
+         return true;
+      }
+
+      if ( rc->slots != NULL ){
+         rc_disk_slot* S = rc_disk_slot_for(rc, K.hash);
+         
+         if ( __atomic_load_n(&S->valid, __ATOMIC_ACQUIRE) == 1 && 
+              rc_same_key(S->K, K) && S->n_steps >= 1 &&
+              (uint64_t)S->n_steps <= rc->hdr->slot_levels &&
+              S->check == rc_slot_check(S) ){
+            const double* cols = (const double*)(S + 1);
+            rc_unpack(cols, S->n_steps, S->cape, S->cin, out);
+            
+            rc_entry E;  // promote
+            E.K = K;
+            E.cape = S->cape;
+            E.cin = S->cin;
+            E.n_steps = S->n_steps;
+            E.cols.assign(cols, cols + RC_N_COLUMNS * S->n_steps);
+            rc_mem_insert(rc, E);
+            
+            rc->hits_disk++;
+            return true;
+         }
+      }
+      
+      rc->misses++;
+      return false;
+      
+   } // End rc_lookup
+
+
+   void rc_store(result_cache* rc, const rc_key& K,
+                 const packaged_computations& AB){
+
+      rc_entry E;
+      E.K = K;
+      E.cape = AB.cape;
+      E.cin = AB.cin;
+      E.n_steps = AB.n_steps;
+      E.cols.resize(RC_N_COLUMNS * AB.n_steps);
+      rc_pack(AB, &E.cols[0]);
+
+      std::lock_guard<std::mutex> guard(rc->lock);
+      
+      rc_mem_insert(rc, E);
+      
+// Profiles longer than the slots of this file stay in memory only.
+      if ( rc->slots != NULL && (uint64_t)AB.n_steps <= rc->hdr->slot_levels ){
+         rc_disk_slot* S = rc_disk_slot_for(rc, K.hash);
+         __atomic_store_n(&S->valid, 0, __ATOMIC_RELAXED);
+         __atomic_thread_fence(__ATOMIC_RELEASE);
+         S->K = K;
+         S->cape = AB.cape;
+         S->cin = AB.cin;
+         S->n_steps = AB.n_steps;
+         memcpy(S + 1, &E.cols[0], E.cols.size() * sizeof(double));
+         S->check = rc_slot_check(S);
+         __atomic_store_n(&S->valid, 1, __ATOMIC_RELEASE);
+      }
+      
+      rc->stores++;
+      
+   } // End rc_store
+
+
+   void rc_print_stats(result_cache* rc){
+
+      if ( rc == NULL ){ return; }
+      
+      long lookups = rc->hits_mem + rc->hits_disk + rc->misses;
+      double rate = lookups > 0 ? 
+         100.0 * (rc->hits_mem + rc->hits_disk) / lookups : 0.0;
+      
+      printf("> Cache: %ld lookups, %ld memory hits, %ld disk hits, "
+             "%ld misses (%.1f%% hit rate)\n",
+             lookups, rc->hits_mem, rc->hits_disk, rc->misses, rate);
+      printf("> Cache: %ld stores, %ld evictions, %zu memory entries "
+             "(%.1f of %.1f MB), %llu disk slots of %llu levels\n",
+             rc->stores, rc->evictions, rc->lru.size(),
+             rc->mem_bytes / 1048576.0, rc->mem_capacity / 1048576.0,
+             rc->hdr != NULL ? (unsigned long long)rc->hdr->n_slots : 0ULL,
+             rc->hdr != NULL ? (unsigned long long)rc->hdr->slot_levels : 0ULL);
+             
+   } // End rc_print_stats
+
+
+// --------------------------------------------------------------------
+// Drop in replacement for parcel_motion_driver(). Runs with console
+// output are always computed, since a cache hit would have nothing to
+// print.
+// --------------------------------------------------------------------
+
+   packaged_computations cached_parcel_motion_driver(result_cache* rc,
+      double pMB, double TC, double qv, double qc, double qw,
+      double qvs, double rh_i, double dpMB, double ptopMB, 
+      int console_output){
+
+      if ( rc == NULL || console_output == 1 ){
+         return parcel_motion_driver(pMB,TC,qv,qc,qw,qvs,rh_i,dpMB,
+                                     ptopMB,console_output);
+      }
+      
+      rc_key K;
+      uint64_t h = rc_make_key(pMB,dpMB,ptopMB,TC,qv,qc,rh_i,&K);
+      
+      packaged_computations AB;
+      
+      if ( h != 0 && rc_lookup(rc, K, &AB) ){ return AB; }
+      
+      AB = parcel_motion_driver(pMB,TC,qv,qc,qw,qvs,rh_i,dpMB,
+                                ptopMB,console_output);
+                                
+      if ( h != 0 ){ rc_store(rc, K, AB); }
+      
+      return AB;
+      
+   } // All done!
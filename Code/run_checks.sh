@@ -0,0 +1,406 @@
+#!/bin/sh
+#
+# run_checks.sh
+# Regression checks, run by 'make check' after the build. Every run
+# happens in a scratch directory. Most checks compare outputs that
+# must be byte for byte the same, each section covers one feature.
+#
+# -- Licence --
+# Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+# and Jeffery Fitzgerald is licensed under a Creative Commons
+# Attribution-NonCommercial-ShareAlike 4.0 International License.
+#
+# You can read the full licence and get the most recent code at
+# https://github.com/whokilledkermit/parcel_model
+#
+# --------------------------------------------------------------------
+
+here=$(cd "$(dirname "$0")" && pwd)
+model="$here/p_model_R4_build_2"
+merge="$here/p_model_merge"
+pmz="$here/p_model_pmz"
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+cd "$tmp" || exit 1
+
+# The run of 'run_parcel_model.csh', less the console
+args="1 0 0.01 10 1000 10 500 20 14.8e-3 0 14.8e-3 0 0.5"
+n_fail=0
+
+# check <name> <command ...>, the command's status is the result
+check(){
+   name=$1; shift
+   if "$@" >> log.txt 2>&1; then
+      echo "ok      $name"
+   else
+      echo "FAILED  $name"
+      n_fail=$((n_fail + 1))
+   fi
+}
+
+run(){ "$model" "$@" >> log.txt 2>&1; }
+
+clean(){ rm -f results.* cape.*; }
+
+# The reference every other run is compared against
+run $args
+cp results.txt serial.txt
+
+
+# --------------------------------------------------------------------
+# Output projection (--vars, --levels, --level-stride), against the
+# full output filtered with awk. Levels i of a trial are 0 .. 100, the
+# way down revisits grid level j = 100 - i.
+# --------------------------------------------------------------------
+
+clean; run --vars qc,p $args
+{ echo "# P_MB, QC"; awk -F, 'NR > 1 { print $1 "," $5 }' serial.txt; } \
+   > want.txt
+check "--vars keeps only the wanted columns" cmp results.txt want.txt
+
+clean; run --levels 850,700 $args
+{ head -n 1 serial.txt; awk -F, 'NR > 1 && ($1 == 850 || $1 == 700)' \
+   serial.txt; } > want.txt
+check "--levels keeps only those pressures" cmp results.txt want.txt
+
+clean; run --level-stride 3 $args
+{ head -n 1 serial.txt; awk -F, 'NR > 1 { i = (NR - 2) % 101;
+   j = i <= 50 ? i : 100 - i; if ( j % 3 == 0 ) print }' serial.txt; } \
+   > want.txt
+check "--level-stride keeps every 3rd grid level" cmp results.txt want.txt
+
+clean; run --vars t --level-stride 2 --levels 900,850 $args
+{ echo "# T"; awk -F, 'NR > 1 && $1 == 900 { print $2 }' serial.txt; } \
+   > want.txt
+check "--levels and --level-stride combine" cmp results.txt want.txt
+
+clean
+check "--levels off the grid is refused" \
+   sh -c "! '$model' --levels 450 $args"
+check "--levels above the launch is refused" \
+   sh -c "! '$model' --levels 1010 $args"
+
+
+# --------------------------------------------------------------------
+# Daemon mode (--serve), see parcel_servercheck.cpp
+# --------------------------------------------------------------------
+
+"$model" --serve "$tmp/pm.sock" --workers 2 >> log.txt 2>&1 &
+server=$!
+n=0
+while [ ! -S "$tmp/pm.sock" ] && [ $n -lt 50 ]; do sleep 0.1; n=$((n + 1)); done
+"$here/p_model_servercheck" "$tmp/pm.sock" > server.txt 2>&1
+status=$?
+kill $server; wait $server 2> /dev/null
+cat server.txt >> log.txt
+grep -v '^Parcel server error' server.txt
+check "server checks" test $status -eq 0
+
+
+# --------------------------------------------------------------------
+# Result cache (--cache), unperturbed runs. The same inputs under
+# --ice or another sounding must not come back from the cache.
+# --------------------------------------------------------------------
+
+flat="1 0 0 5 1000 10 500 20 14.8e-3 0 14.8e-3 0 0.5"
+cache="--cache $tmp/cache.bin --cache-disk-mb 4"
+
+clean; run $flat; cp results.txt want.txt
+clean; run $cache $flat
+check "cached run matches uncached" cmp results.txt want.txt
+clean; "$model" $cache --cache-mb 0 $flat > cache.txt 2>&1
+cat cache.txt >> log.txt
+check "disk tier hits match uncached" cmp results.txt want.txt
+check "disk tier answers every trial" grep -q "5 disk hits" cache.txt
+
+clean; run --ice $flat; cp results.txt want.txt
+clean; run --ice $cache $flat
+check "--ice doesn't take liquid entries" cmp results.txt want.txt
+
+printf '1000 24 14e-3\n500 -15 5e-4\n' > snd_a.txt
+printf '1000 22 12e-3\n500 -18 4e-4\n' > snd_b.txt
+clean; run --sounding snd_a.txt $cache $flat
+clean; run --sounding snd_b.txt $flat; cp results.txt want.txt
+clean; run --sounding snd_b.txt $cache $flat
+check "soundings don't share entries" cmp results.txt want.txt
+
+
+# --------------------------------------------------------------------
+# Compressed output (--compress) and its decoder
+# --------------------------------------------------------------------
+
+clean; run --compress $args
+"$pmz" results.pmz decoded.txt >> log.txt 2>&1
+check "--compress decodes to the text output" cmp decoded.txt serial.txt
+"$pmz" results.pmz --trial 7 > trial.txt 2>> log.txt
+{ head -n 1 serial.txt; awk 'NR >= 2 + 7*101 && NR < 2 + 8*101' \
+   serial.txt; } > want.txt
+check "--trial reads one trial" cmp trial.txt want.txt
+
+# Size, gzip -9 gets 718 KB of text down to 180 KB (4x)
+many="1 0 0.01 200 1000 10 500 20 14.8e-3 0 14.8e-3 0 0.5"
+clean; run $many; mv results.txt many.txt
+run --compress $many
+check "--compress is 10x smaller on 200 trials" \
+   test $(($(wc -c < results.pmz) * 10)) -lt $(wc -c < many.txt)
+
+# Trials longer than a block
+long="1 0 0.01 2 1000 0.01 600 20 14.8e-3 0 14.8e-3 0 0.5"
+clean; run $long; cp results.txt want.txt
+clean; run --compress $long
+"$pmz" results.pmz decoded.txt >> log.txt 2>&1
+check "--compress with trials over several blocks" cmp decoded.txt want.txt
+
+# A block header claiming a huge payload
+clean; run --compress $args
+printf '\377\377\377\377\377\377\377\177' | \
+   dd of=results.pmz bs=1 seek=56 conv=notrunc 2> /dev/null
+check "damaged block size is refused" \
+   sh -c "! '$pmz' results.pmz decoded.txt"
+
+
+# --------------------------------------------------------------------
+# Split output (--split-output), joined back with 'p_model_merge --parts'
+# --------------------------------------------------------------------
+
+clean; rm -f results.txt.*
+run --split-output --threads 3 $args
+"$merge" results.txt --parts >> log.txt 2>&1
+check "--split-output parts join to the serial output" cmp results.txt serial.txt
+
+clean; rm -f results.txt.*
+run --split-output --stream --threads 2 $args
+"$merge" results.txt --parts >> log.txt 2>&1
+check "--split-output with --stream" cmp results.txt serial.txt
+
+
+# --------------------------------------------------------------------
+# Sharded runs (--shard k/N) and 'p_model_merge'
+# --------------------------------------------------------------------
+
+clean
+for k in 0 1 2; do run --shard $k/3 $args; done
+"$merge" results.txt 3 >> log.txt 2>&1
+check "3 shards merge to the serial output" cmp results.txt serial.txt
+
+# More shards than trials, some are empty
+few="1 0 0.01 3 1000 10 500 20 14.8e-3 0 14.8e-3 0 0.5"
+clean; run $few; cp results.txt want.txt
+clean
+for k in 0 1 2 3; do run --shard $k/4 $few; done
+"$merge" results.txt 4 >> log.txt 2>&1
+check "empty shards merge" cmp results.txt want.txt
+
+# A shard cut short
+clean
+for k in 0 1 2; do run --shard $k/3 $args; done
+head -c 1000 results.txt.shard-1-of-3 > cut.txt
+mv cut.txt results.txt.shard-1-of-3
+check "a cut shard stops the merge" sh -c "! '$merge' results.txt 3"
+
+# Only runs that wrote CAPE/CIN merge 'cape.txt', whatever else lies
+# in the directory
+clean
+for k in 0 1 2; do run --shard $k/3 $args; done
+echo "# TRIAL, CAPE, CIN" > cape.txt.shard-0-of-3
+"$merge" results.txt 3 >> log.txt 2>&1
+check "shards without a sounding merge no cape.txt" \
+   sh -c "cmp results.txt serial.txt && test ! -e cape.txt"
+
+# Split output of each shard, joined, then merged
+clean
+for k in 0 1 2; do
+   run --shard $k/3 --split-output --threads 2 $args
+   "$merge" results.txt.shard-$k-of-3 --parts >> log.txt 2>&1
+done
+"$merge" results.txt 3 >> log.txt 2>&1
+check "--split-output shards merge" cmp results.txt serial.txt
+
+
+# --------------------------------------------------------------------
+# Adiabat table (--build-table, --query-table). At a grid node the
+# query must agree with a run of the solver.
+# --------------------------------------------------------------------
+
+axes="--table-pmb 990:1010:3 --table-tc 18:22:3 --table-qv 14e-3:15.6e-3:3"
+one="1 0 0 1 1000 10 500 20 14.8e-3 0 14.8e-3 0 0.5"
+clean; run --build-table table.pat $axes $one
+run $one
+printf '1000 20 14.8e-3 850\n1000 20 14.8e-3 700\n' > points.txt
+"$model" --query-table table.pat < points.txt > query.txt 2>> log.txt
+cat query.txt >> log.txt
+# query: P_MB in $4, T $6 QV $7 QC $8; results: P_MB, T, TH, QV, QC
+check "--query-table matches the solver at a node" awk -F, '
+   FNR == 1 { f++ }
+   f == 1 && NR > 1 && !($1 in T) { T[$1] = $2; QV[$1] = $4; QC[$1] = $5 }
+   f == 2 && /^1000,/ { n++; d = $6 - T[$4]; e = $7 - QV[$4]; g = $8 - QC[$4]
+      if ( d*d > 1e-4 || e*e > 1e-4 || g*g > 1e-4 ) bad = 1 }
+   END { exit (n == 2 && !bad) ? 0 : 1 }' results.txt query.txt
+
+check "a liquid table is refused under --ice" \
+   sh -c "! '$model' --ice --query-table table.pat < points.txt"
+
+
+# --------------------------------------------------------------------
+# Checkpoint and resume (--checkpoint-every, --resume). The checkpoint
+# of a finished run is set back to trial 4, as if the run had died
+# there with part of trial 4 written, then resumed.
+# --------------------------------------------------------------------
+
+clean; run --checkpoint-every 2 $args
+bytes=$(head -n 405 serial.txt | wc -c)
+sed -e "s/^trials_done .*/trials_done 4/" -e "s/^rng_draws .*/rng_draws 8/" \
+    -e "s/^output_bytes .*/output_bytes $bytes/" results.txt.ckpt > ckpt.txt
+mv ckpt.txt results.txt.ckpt
+head -c $((bytes + 100)) serial.txt > results.txt
+run --checkpoint-every 2 --resume $args
+check "--resume after a crash matches an uninterrupted run" \
+   cmp results.txt serial.txt
+
+check "--resume with other parameters is refused" \
+   sh -c "! '$model' --resume 1 0 0.02 10 1000 10 500 20 14.8e-3 0 14.8e-3 0 0.5"
+
+
+# --------------------------------------------------------------------
+# Sensitivities (--sensitivity). The values are those of a plain run,
+# and dT/dTC, dQV/dTC against a central difference of TC +- 0.5 C.
+# --------------------------------------------------------------------
+
+at(){ echo "1 0 0 1 1000 10 500 $1 14.8e-3 0 14.8e-3 0 0.5"; }
+clean; run --sensitivity $(at 20)
+run $(at 20)
+awk -F, '{ print $1 "," $2 "," $6 "," $10 "," $14 }' sensitivity.txt \
+   | sed 1d > values.txt
+check "--sensitivity values match a plain run" \
+   sh -c "sed 1d results.txt | cmp - values.txt"
+
+run $(at 20.5); mv results.txt hi.txt
+run $(at 19.5); mv results.txt lo.txt
+paste -d, hi.txt lo.txt | sed 1d > fd.txt
+# fd.txt: P T TH QV QC of TC + 0.5, then the same of TC - 0.5
+check "--sensitivity agrees with finite differences" awk -F, '
+   FNR == 1 { f++ }
+   f == 1 && FNR > 1 && $1 <= 900 && !($1 in dT) { dT[$1] = $3; dQ[$1] = $11 }
+   f == 2 && ($1 in dT) && !($1 in seen) { seen[$1] = 1; n++
+      eT = ($2 - $7) - dT[$1]; eQ = ($4 - $9) - dQ[$1]
+      if ( eT*eT > 1e-4 * dT[$1]^2 || eQ*eQ > 1e-4 * dQ[$1]^2 ) bad++ }
+   END { exit (n == 41 && !bad) ? 0 : 1 }' sensitivity.txt fd.txt
+
+
+# --------------------------------------------------------------------
+# Streaming driver (--stream). The plain run must still give the
+# committed results.txt, and streaming must not change a byte. Runs
+# with more levels than the arrays hold stream by themselves.
+# --------------------------------------------------------------------
+
+check "plain run matches the committed results.txt" \
+   cmp serial.txt "$here/results.txt"
+
+clean; run --stream $args
+check "--stream matches the plain run" cmp results.txt serial.txt
+
+clean; run 1 0 0.01 2 1000 0.1 500 20 14.8e-3 0 14.8e-3 0 0.5
+check "dp = 0.1 mb writes all 10001 levels of each trial" \
+   test $(wc -l < results.txt) -eq 20003
+check "dp = 0.1 mb trials go from 1000 mb to 500 mb and back" \
+   sh -c "test \$(grep -c '^1000,' results.txt) -eq 4 &&
+          test \$(grep -c '^500,' results.txt) -eq 2"
+
+
+# --------------------------------------------------------------------
+# Profiling (--profile). Counters may be unavailable here, so only the
+# counts are checked: every step of every trial, and no output files.
+# --------------------------------------------------------------------
+
+clean; "$model" --profile --threads 2 $args > profile.txt 2>&1
+status=$?
+cat profile.txt >> log.txt
+check "--profile runs" test $status -eq 0
+check "--profile counts 101 steps of 10 trials" \
+   sh -c "grep -A 2 '^> All threads, 10 trials' profile.txt |
+          grep -Eq '^ *driver +step +1010 '"
+check "--profile writes no results" test ! -e results.txt
+
+
+# --------------------------------------------------------------------
+# Grid mode (--grid). The file can't depend on how many threads ran
+# it, and a single column holds what a plain run of it writes (the
+# 152 byte header and one level count come first).
+# --------------------------------------------------------------------
+
+axes="--grid-tc 10:30:6 --grid-qv 8e-3:18e-3:6 --grid-pmb 1000:900:3"
+clean; run --grid grid1.bin --threads 1 $axes $args
+run --grid grid4.bin --threads 4 $axes $args
+check "--grid is the same on 1 and 4 threads" cmp grid1.bin grid4.bin
+
+one="1 0 0 1 1000 10 500 20 14.8e-3 0 14.8e-3 0 0.5"
+clean; run $one
+run --grid column.bin --grid-tc 20:20:1 $one
+od -A n -t f8 -v -j 156 column.bin | awk '{ for (i=1; i<=NF; i++) v[n++] = $i }
+   END { for (r=0; r < n/5; r++) printf "%g,%g,%g,%g,%g\n", v[5*r],
+         v[5*r+1], v[5*r+2], v[5*r+3], v[5*r+4] }' > column.txt
+check "a --grid column matches a plain run" \
+   sh -c "sed 1d results.txt | cmp - column.txt"
+
+
+# --------------------------------------------------------------------
+# Ice and mixed phase (--ice). Warmer than 0 C the adjustment is the
+# liquid one, so the ascent matches a liquid run until the parcel
+# nears freezing. Higher up, freezing releases more latent heat and
+# the parcel is warmer.
+# --------------------------------------------------------------------
+
+cold="1 0 0 1 1000 10 300 20 14.8e-3 0 14.8e-3 0 0.5"
+clean; run $cold; mv results.txt liquid.txt
+run --ice $cold; mv results.txt ice.txt
+# Ascent rows only, 2 .. 72 are 1000 to 300 mb
+paste -d, liquid.txt ice.txt | sed -n 2,72p > both.txt
+check "--ice matches liquid above 2 C" awk -F, '
+   $2 > 275.15 { n++
+                 if ( $2 != $7 || $4 != $9 || $5 != $10 ) bad++ }
+   END { exit (n > 30 && !bad) ? 0 : 1 }' both.txt
+check "--ice is warmer below -5 C" awk -F, '
+   $2 < 268.15 { n++; if ( !($7 > $2) ) bad++ }
+   END { exit (n > 20 && !bad) ? 0 : 1 }' both.txt
+
+clean; run --ice --stream $cold
+check "--ice with --stream matches --ice" cmp results.txt ice.txt
+
+
+# --------------------------------------------------------------------
+# Sounding, buoyancy and CAPE (--sounding). The parcel columns are
+# those of a run without it, B is added, and sharded runs merge both
+# the results and 'cape.txt' into those of a single process.
+# --------------------------------------------------------------------
+
+cat > sounding.txt << 'END'
+# P(mb) T(C) QV(kg/kg)
+1000 24 14e-3
+850  14 9e-3
+700   4 4e-3
+500 -12 1e-3
+END
+
+clean; run --sounding sounding.txt $args
+sed 1d serial.txt > want.txt
+check "--sounding keeps the parcel columns" \
+   sh -c "sed 1d results.txt | cut -d, -f1-5 | cmp - want.txt"
+check "--sounding adds B" grep -q '^# P_MB, T, TH, QV, QC, B$' results.txt
+check "cape.txt has a row for each trial" \
+   sh -c "test \"\$(sed 1d cape.txt | cut -d, -f1 | tr '\n' ' ')\" = \
+          '0 1 2 3 4 5 6 7 8 9 '"
+mv results.txt want.txt; mv cape.txt want_cape.txt
+
+for k in 0 1 2; do run --sounding sounding.txt --shard $k/3 $args; done
+"$merge" results.txt 3 >> log.txt 2>&1
+check "--sounding shards merge the results" cmp results.txt want.txt
+check "--sounding shards merge cape.txt" cmp cape.txt want_cape.txt
+
+
+if [ $n_fail -ne 0 ]; then
+   echo "$n_fail check(s) failed, model output:"
+   cat log.txt
+   exit 1
+fi
+echo "All checks passed."
@@ -8,6 +8,10 @@
 // This function performs an isobaric moist adiabatic adjustment.
 // The final state is either subsaturated with no liquied water 
 // present or exactly saturated with liquid water present.
+//
+// With sat_phase = SAT_PHASE_MIXED the adjustment is to saturation
+// over the mixed-phase surface instead, and 'qc' is the total
+// condensate, liquid and ice (see compute_esat_ice.cpp).
 // 
 // Units: SI(MKS)
 // 
@@ -16,17 +20,21 @@
 // QV: mixing ratio of water vapor, q_v (kg/kg)
 // QC: mixing ratio of liquid water, q_c (kg/kg)
 // 
-// Returns: struct adjusted_sat
+// Returns: struct adjusted_sat (adjusted_sat_t<real>)
 // theta: adjusted potential temperature, theta^{n+1} (K)
 // qv: adjusted mixing ratio of water vapor, q_v^{n+1} (kg/kg)
 // qc: adjusted mixing ratio of liquid water, q_c^{n+1} (kg/kg)
 // qvs: saturation mixing ration, q_vs^{n+1} (kg/kg) for TH1, PBAR
 // pibar: Exner function, pi (non-dimensional pressure)
 //
-// ver. 2.0
+// ver. 2.3
 // 
 // -- Change log --
 // March 17, 2015 - Build 2 Release. Build 1 entirely depreciated.
+// October 19, 2026 - Templated on the scalar type, see dual_number.cpp
+// October 19, 2026 - Loop and branch counts for --profile, see
+//                    perf_counters.cpp
+// October 19, 2026 - Mixed-phase option, see compute_esat_ice.cpp
 //
 // -- Licence --
 // Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
@@ -43,16 +51,17 @@
 // --------------------------------------------------------------------
 
 
-   adjusted_sat compute_satadjust(double theta,double qv,
-                                  double qc,double pbar){
+   template <typename real>
+   adjusted_sat_t<real> compute_satadjust(real theta,real qv,
+                                          real qc,real pbar){
    
    extern void print_table_line(); 
    
    //using namespace std;  // for diagnostics
      
 // Variables we will use later
-   double tstar,es1,alpha,theta_e,theta_fac,theta_1,qv_sat,
-          qv1,qc1,qvs1,dT;   
+   real tstar,es1,alpha,theta_e,theta_fac,theta_1,qv_sat,
+        qv1,qc1,qvs1,dT;   
 
 // physical constants
    double hlf = 2.5e6;      // latent heat
@@ -64,6 +73,7 @@
 // is less than dT_crit
    int do_it = 1;
    int itt = 1;
+   int n_dry = 0; // passes that took the qc1 < 0 branch, for profiling
    
    double ittmax = 10; // max number of iterations allowed, failsafe
    double dT_crit = 0.001; // numerical resolution
@@ -75,13 +85,13 @@
 // 'pbar' is a (hydrostatic) reference pressure field, we will use this
 // in the Exner function to compute 'pibar'. 'pi' at environmental
 // temperature. 
-   double pibar = pow( (pbar / pzero),( rgas/cp ) );
+   real pibar = pow( (pbar / pzero),( rgas/cp ) );
 
-   double gamma = hlf / ( cp*pibar );
+   real gamma = hlf / ( cp*pibar );
 
-   double theta_star = theta;
-   double qv_star = qv;
-   double qw = qv + qc;
+   real theta_star = theta;
+   real qv_star = qv;
+   real qw = qv + qc;
 
 
 // Start the computation loop. We will stay in here until the 'dT_crit'
@@ -89,9 +99,16 @@
    while (do_it == 1){
 
       tstar = theta_star * pibar; // temp star
-      es1 = compute_esat_pa( tstar );
-
-      alpha = compute_alpha(pbar,pibar,tstar);
+      
+      if ( sat_phase == SAT_PHASE_MIXED ){
+         es1 = compute_esat_mixed_pa( tstar );
+         alpha = compute_alpha_mixed(pbar,pibar,tstar);
+         gamma = compute_latent_mixed( tstar ) / ( cp*pibar );
+      }else{
+         es1 = compute_esat_pa( tstar );
+         alpha = compute_alpha(pbar,pibar,tstar);
+      }
+      
       theta_fac = gamma / ( 1 + gamma*alpha );
       qv_sat = 0.622 / ( pbar-es1 ) * es1;
 
@@ -104,6 +121,7 @@
       qvs1 = qv_sat + alpha * ( theta_1-theta_star );
 
       if( qc1 < 0 ){
+         n_dry++;
          qc1 = 0;
          qv1 = qw;
          theta_1 = theta_star + gamma * ( qv_star-qv1 );
@@ -135,9 +153,15 @@
 
    } // End while loop
 
+// Only set while profiling
+   if ( satadjust_probe != NULL ){
+      sa_probe_record(satadjust_probe, value_of(theta), value_of(qv),
+                      value_of(qc), value_of(pbar), itt - 1, n_dry);
+   }
+
 
 // Package up the variables and send them back
-   adjusted_sat rtn;
+   adjusted_sat_t<real> rtn;
    
    rtn.theta = theta_1;
    rtn.qv = qv1;
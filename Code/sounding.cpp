@@ -0,0 +1,192 @@
+//
+// sounding.cpp
+// Environmental sounding (--sounding <file>). With a sounding loaded
+// the driver compares the parcel against its environment as it goes:
+// every level gets its buoyancy, and CAPE and CIN are summed over the
+// ascent, so no second pass over the results is needed.
+//
+// The file holds one level per line, '#' starts a comment:
+//    P (mb)   T (C)   QV (kg/kg)
+// in any order, at least two levels.
+//
+// Parcel levels all sit on the dpMB grid from pMB, so before the run
+// snd_build_index() finds, once, the two sounding levels around each
+// grid level and the weight between them (linear in ln p). A step of
+// the driver then costs one table read and one interpolation.
+//
+//    B    = g (Tv - Tv_env) / Tv_env
+//    CAPE = Rd * integral of (Tv - Tv_env) dln p where positive
+//    CIN  = the same where negative, below the first positive layer
+// Tv of the parcel includes the condensate loading, T (1 + 0.608 qv - qc).
+// CIN is reported as a negative number, J/kg like CAPE.
+//
+// Levels outside the sounding take the value at its nearest end.
+//
+// ver. 1.0
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <algorithm>
+   #include <array>
+   #include <vector>
+
+   const double snd_g = 9.81;       // gravity (m/s^2)
+   const double snd_Rd = 287.0;     // gas constant for dry air
+
+   struct snd_profile {
+      std::vector<double> p_mb;     // decreasing
+      std::vector<double> T_K;
+      std::vector<double> qv;       // kg/kg
+      std::vector<double> Tv;       // virtual temperature (K)
+   };
+
+// The sounding on the grid of one run, levels j = 0 .. n_cycles at
+// pMB - j dpMB.
+   struct snd_index {
+      snd_profile S;
+      double pMB, dpMB, ptopMB;     // the run it was built for
+      long n_cycles;
+      std::vector<int> k;           // sounding level at or below p_j
+      std::vector<double> w;        // weight of level k+1
+      std::vector<double> dlnp;     // ln(p_{j-1} / p_j), 0 for j = 0
+      int n_clamped;                // grid levels outside the sounding
+   };
+
+// Set once by main() before any run starts, NULL = no sounding.
+   const snd_index* env_sounding = NULL;
+
+
+   template <typename real>
+   real snd_virtual_temp(real T_K, real qv, real qc){
+      return T_K * (1.0 + 0.608 * qv - qc);
+   }
+
+
+// Reads a sounding. Returns 0 on success.
+   int snd_read(const char* path, snd_profile* S){
+
+      FILE* fp = fopen(path, "r");
+      if ( fp == NULL ){
+         perror(path);
+         return 1;
+      }
+
+      std::vector<std::array<double,3> > rows;
+      char line[512];
+      int n_line = 0;
+
+      while ( fgets(line, sizeof(line), fp) != NULL ){
+         n_line++;
+
+         char* c = strchr(line, '#');
+         if ( c != NULL ){ *c = 0; }
+
+         std::array<double,3> r;
+         int n = sscanf(line, "%lf %lf %lf", &r[0], &r[1], &r[2]);
+
+         if ( n == EOF || n == 0 ){ continue; }
+         if ( n != 3 || !(r[0] > 0) ){
+            printf("%s:%d: want 'P(mb) T(C) QV(kg/kg)'\n", path, n_line);
+            fclose(fp);
+            return 1;
+         }
+         rows.push_back(r);
+      }
+      fclose(fp);
+
+      std::sort(rows.begin(), rows.end(),
+                [](const std::array<double,3>& a,
+                   const std::array<double,3>& b){ return a[0] > b[0]; });
+
+      S->p_mb.clear();  S->T_K.clear();  S->qv.clear();  S->Tv.clear();
+
+      for (size_t i=0; i < rows.size(); i++){
+         if ( i > 0 && rows[i][0] == rows[i-1][0] ){
+            printf("%s: two levels at %g mb\n", path, rows[i][0]);
+            return 1;
+         }
+         S->p_mb.push_back(rows[i][0]);
+         S->T_K.push_back(rows[i][1] + 273.15);
+         S->qv.push_back(rows[i][2]);
+         S->Tv.push_back(snd_virtual_temp(S->T_K.back(), rows[i][2], 0.0));
+      }
+
+      if ( S->p_mb.size() < 2 ){
+         printf("%s: a sounding needs at least two levels\n", path);
+         return 1;
+      }
+
+      return 0;
+
+   } // End snd_read
+
+
+// Lines the sounding up with the levels of a run. One pass down both,
+// the grid and the sounding are each in decreasing pressure.
+   snd_index* snd_build_index(const snd_profile& S, double pMB,
+                              double dpMB, double ptopMB){
+
+      snd_index* E = new snd_index;
+      E->S = S;
+      E->pMB = pMB;
+      E->dpMB = dpMB;
+      E->ptopMB = ptopMB;
+      E->n_cycles = (long)((pMB-ptopMB)/dpMB);
+      E->n_clamped = 0;
+
+      long n = E->n_cycles + 1;
+      E->k.resize(n);
+      E->w.resize(n);
+      E->dlnp.resize(n);
+
+      int n_s = S.p_mb.size();
+      int k = 0;
+
+      for (long j=0; j < n; j++){
+
+         double p = pMB - j * dpMB;
+
+         while ( k < n_s - 2 && S.p_mb[k+1] >= p ){ k++; }
+
+         double w = log(S.p_mb[k] / p) / log(S.p_mb[k] / S.p_mb[k+1]);
+         if ( w < 0 || w > 1 ){
+            w = w < 0 ? 0 : 1;
+            E->n_clamped++;
+         }
+
+         E->k[j] = k;
+         E->w[j] = w;
+         E->dlnp[j] = j == 0 ? 0 : log((p + dpMB) / p);
+      }
+
+      return E;
+
+   } // End snd_build_index
+
+
+// The sounding for a run, if one is loaded and it was built for this
+// grid.
+   inline const snd_index* snd_for_run(double pMB, double dpMB,
+                                       double ptopMB){
+      const snd_index* E = env_sounding;
+      if ( E == NULL || E->pMB != pMB || E->dpMB != dpMB ||
+           E->ptopMB != ptopMB ){ return NULL; }
+      return E;
+   }
+
+// Environmental Tv at grid level j
+   inline double snd_env_Tv(const snd_index* E, long j){
+      int k = E->k[j];
+      return E->S.Tv[k] + E->w[j] * (E->S.Tv[k+1] - E->S.Tv[k]);
+   }
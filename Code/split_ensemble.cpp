@@ -0,0 +1,151 @@
+//
+// split_ensemble.cpp
+// Ensemble runs with split output (--split-output). The trials are
+// handed out to '--threads' worker threads one at a time, each worker
+// appends the trials it ran to its own part file and indexes them (see
+// trial_index.cpp). Nothing is shared between the workers but the
+// trial counter and the result cache.
+//
+// 'p_model_merge <results file> --parts' reads the parts back in trial
+// order into the 'results.txt' a serial run would have written.
+//
+// Rows go straight to the part file as they are made, with '--stream'
+// a worker holds a single level at a time.
+//
+// ver. 1.1
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - Rows written through instead of a trial at a time
+// October 19, 2026 - Reports the bytes written, for shard checkpoints
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <atomic>
+   #include <thread>
+   #include <vector>
+
+   struct se_job {
+      double pMB, qv, qc, qw, qvs, rh_i, dpMB, ptopMB;
+      const std::vector<double>* TC;   // one per trial
+      uint64_t first;                  // trial number of TC[0]
+      int do_stream;
+      result_cache* rc;
+      ti_writer* w;
+      std::atomic<size_t> next;
+      std::atomic<int> n_errors;
+      std::atomic<uint64_t> n_bytes;   // text written, all parts
+   };
+
+
+// Formats one trial exactly as write_output_csv would.
+   void se_run_trial(se_job* job, double TC, std::ostream& out){
+
+      if ( job->do_stream == 1 ){
+         csv_stream_sink sink = { &out, 0, 0, 0 };
+         parcel_motion_stream(job->pMB, TC, job->qv, job->qc, job->qw,
+                              job->qvs, job->rh_i, job->dpMB, job->ptopMB,
+                              0, sink);
+         return;
+      }
+
+      packaged_computations AB;
+      AB = cached_parcel_motion_driver(job->rc, job->pMB, TC, job->qv,
+                                       job->qc, job->qw, job->qvs,
+                                       job->rh_i, job->dpMB, job->ptopMB, 0);
+
+      for (int k=0; k < AB.n_steps; k++){
+         write_output_row(out, AB.p_mb[k], AB.T_K[k], AB.theta_K[k],
+                          AB.qv_gkg[k], AB.qc_gkg[k]);
+      }
+
+   } // End se_run_trial
+
+
+   void se_worker(se_job* job, uint32_t k){
+
+      ti_part part;
+      if ( ti_open_part(job->w, k, &part) != 0 ){
+         job->n_errors++;
+         return;
+      }
+
+      std::ostream out(&part.buf);
+
+      size_t i;
+      while ( (i = job->next++) < job->TC->size() ){
+
+         ti_begin_trial(&part);
+         se_run_trial(job, (*job->TC)[i], out);
+
+         if ( ti_end_trial(job->w, &part, job->first + i) != 0 ){
+            job->n_errors++;
+         }
+      }
+
+      job->n_bytes += part.buf.n;
+      if ( ti_close_part(&part) != 0 ){ job->n_errors++; }
+
+   } // End se_worker
+
+
+// --------------------------------------------------------------------
+// Runs trials first .. first + TC.size() - 1 into the parts and index
+// of 'base', and sets 'n_bytes' to the length of their text. Returns 0
+// on success.
+// --------------------------------------------------------------------
+
+   int run_split_ensemble(const std::string& base, double pMB,
+                          const std::vector<double>& TC, double qv,
+                          double qc, double qw, double qvs, double rh_i,
+                          double dpMB, double ptopMB, uint64_t first,
+                          int do_stream, result_cache* rc, int n_threads,
+                          uint64_t* n_bytes){
+
+      if ( n_threads < 1 ){ n_threads = 1; }
+
+      se_job job;
+      job.pMB = pMB;    job.qv = qv;     job.qc = qc;
+      job.qw = qw;      job.qvs = qvs;   job.rh_i = rh_i;
+      job.dpMB = dpMB;  job.ptopMB = ptopMB;
+      job.TC = &TC;
+      job.first = first;
+      job.do_stream = do_stream;
+      job.rc = rc;
+      job.next = 0;
+      job.n_errors = 0;
+      job.n_bytes = 0;
+
+      job.w = ti_open_write(base, first, TC.size(), n_threads);
+      if ( job.w == NULL ){ return 1; }
+
+      printf("> %zu trials on %d threads into %s.part-*\n", TC.size(),
+             n_threads, base.c_str());
+
+      std::vector<std::thread> pool;
+      for (int t=0; t < n_threads; t++){
+         pool.push_back(std::thread(se_worker, &job, (uint32_t)t));
+      }
+      for (int t=0; t < n_threads; t++){
+         pool[t].join();
+      }
+
+      if ( ti_close_write(job.w) != 0 || job.n_errors > 0 ){
+         printf("> Error writing %s!\n", base.c_str());
+         return 1;
+      }
+
+      printf("> Index written to %s\n", ti_index_name(base).c_str());
+      *n_bytes = job.n_bytes;
+
+      return 0;
+
+   } // End run_split_ensemble
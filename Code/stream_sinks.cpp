@@ -0,0 +1,92 @@
+// 
+// stream_sinks.cpp
+// Ready made sinks for parcel_motion_stream(). A sink is anything
+// that can be called with a 'const parcel_level&', it sees every level
+// once, in order, and keeps whatever it needs.
+//
+//    csv_stream_sink   writes each level straight to the results file
+//    reducing_sink     keeps running summaries only
+//    pmz_stream_sink   appends each level to a compressed .pmz file
+//    callback_sink     forwards each level to a C style callback
+//
+// ver. 1.1
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - Buoyancy column in csv_stream_sink
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+// Same columns and formatting as write_output_csv(), plus buoyancy
+// if 'with_buoy' is set.
+   struct csv_stream_sink {
+      std::ostream* out;
+      int with_buoy;
+      double cape, cin;   // of the run so far
+      
+      void operator()(const parcel_level& L){
+         write_output_row(*out, L.p_mb, L.T_K(), L.theta_K, 
+                          L.qv_gkg, L.qc_gkg, with_buoy ? &L.buoy : NULL);
+         cape = L.cape;
+         cin = L.cin;
+      }
+   };
+
+
+// Compressed output, see pmz_codec.cpp
+   struct pmz_stream_sink {
+      pmz_writer* w;
+      
+      void operator()(const parcel_level& L){
+         pmz_append_row(w, L.p_mb, L.T_K(), L.theta_K, L.qv_gkg, L.qc_gkg);
+      }
+   };
+
+
+// Summary of a run without keeping any of it.
+   struct reducing_sink {
+      long n_levels;
+      double min_T_K;      // coldest point of the run
+      double max_qc_gkg;   // most condensate ...
+      double p_max_qc;     // ... and where it was
+      parcel_level last;   // final state
+      
+      reducing_sink(){
+         n_levels = 0;
+         min_T_K = 1.e30;
+         max_qc_gkg = -1.e30;
+         p_max_qc = 0;
+      }
+      
+      void operator()(const parcel_level& L){
+         double T = L.T_K();
+         
+         if ( T < min_T_K ){ min_T_K = T; }
+         if ( L.i > 0 && L.qc_gkg > max_qc_gkg ){
+            max_qc_gkg = L.qc_gkg;
+            p_max_qc = L.p_mb;
+         }
+         
+         last = L;
+         n_levels++;
+      }
+   };
+
+
+// For callers that want a plain function pointer.
+   typedef void (*level_callback)(const parcel_level& L, void* ctx);
+
+   struct callback_sink {
+      level_callback fn;
+      void* ctx;
+      
+      void operator()(const parcel_level& L){ fn(L, ctx); }
+   };
@@ -0,0 +1,332 @@
+//
+// trial_index.cpp
+// Split output: each worker thread appends the trials it runs to its
+// own part file, '<results>.part-k', and records where each trial went
+// in a shared index, '<results>.idx'. No two workers touch the same
+// bytes, so writing needs no locks and scales with the workers.
+//
+// The index is a header followed by one fixed size record per trial,
+// in trial order:
+//    ti_header
+//    ti_record [n_trials]   { part, length, offset }
+// so finding trial t is a single read at a known offset. Each record
+// is written by the worker that ran the trial, after its text has been
+// flushed out of the part's stdio buffer, so a record never points
+// past what the part file holds, even if the process dies. (It is not
+// fsync'd, a power loss can lose trials.) A record with part
+// TI_NO_PART is a trial that never ran.
+//
+// Workers write rows straight through an ostream on the part file
+// (ti_part_buf), so a trial is never held in memory whatever its
+// number of levels.
+//
+// Trials are stored exactly as they appear in 'results.txt', the
+// reader (ti_open_read, ti_next, ti_read_trial) hands them back in
+// trial order or one at a time.
+//
+// ver. 1.1
+//
+// -- Change log --
+// October 19, 2026 - Initial Release
+// October 19, 2026 - Trials are written through, and flushed before
+//                    they are indexed
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+
+   #include <stdint.h>
+   #include <unistd.h>
+   #include <fcntl.h>
+   #include <sys/stat.h>
+   #include <ostream>
+   #include <streambuf>
+   #include <vector>
+   #include <string>
+
+   #define TI_MAGIC    0x58444954   // "TIDX"
+   #define TI_VERSION  1
+   #define TI_NO_PART  0xFFFFFFFF
+
+   struct ti_header {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t n_parts;
+      uint32_t pad;
+      uint64_t first_trial;   // trial number of record 0
+      uint64_t n_trials;
+   };
+
+   struct ti_record {
+      uint32_t part;          // which part file, TI_NO_PART if missing
+      uint32_t length;        // bytes of text
+      uint64_t offset;        // where it starts in the part file
+   };
+
+   std::string ti_part_name(const std::string& base, uint32_t k){
+      return base + ".part-" + std::to_string(k);
+   }
+
+   std::string ti_index_name(const std::string& base){
+      return base + ".idx";
+   }
+
+
+// --------------------------------------------------------------------
+// Writer
+// --------------------------------------------------------------------
+
+   struct ti_writer {
+      int idx_fd;
+      ti_header hdr;
+      std::string base;
+   };
+
+// Lets an ostream write into a part file. Bytes go into the FILE's
+// own buffer and are counted, and std::endl doesn't flush, the part is
+// flushed once per trial by ti_end_trial.
+   struct ti_part_buf : public std::streambuf {
+      FILE* fp;
+      uint64_t n;    // bytes written so far
+      int failed;
+      
+      int overflow(int c){
+         if ( c == EOF ){ return 0; }
+         if ( fputc(c, fp) == EOF ){
+            failed = 1;
+            return EOF;
+         }
+         n++;
+         return c;
+      }
+      std::streamsize xsputn(const char* s, std::streamsize k){
+         size_t w = fwrite(s, 1, k, fp);
+         n += w;
+         if ( w != (size_t)k ){ failed = 1; }
+         return w;
+      }
+      int sync(){ return 0; }
+   };
+
+// One per worker thread
+   struct ti_part {
+      FILE* fp;
+      uint32_t k;
+      uint64_t start;    // where the current trial began
+      ti_part_buf buf;
+   };
+
+
+// Creates the index with every trial missing. Returns NULL on error.
+   ti_writer* ti_open_write(const std::string& base, uint64_t first_trial,
+                            uint64_t n_trials, uint32_t n_parts){
+
+      std::string name = ti_index_name(base);
+      int fd = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if ( fd < 0 ){
+         perror(name.c_str());
+         return NULL;
+      }
+
+      ti_header H;
+      H.magic = TI_MAGIC;
+      H.version = TI_VERSION;
+      H.n_parts = n_parts;
+      H.pad = 0;
+      H.first_trial = first_trial;
+      H.n_trials = n_trials;
+
+      std::vector<ti_record> empty(n_trials);
+      for (size_t t=0; t < empty.size(); t++){
+         empty[t].part = TI_NO_PART;
+         empty[t].length = 0;
+         empty[t].offset = 0;
+      }
+
+      size_t bytes = n_trials * sizeof(ti_record);
+      if ( pwrite(fd, &H, sizeof(H), 0) != (ssize_t)sizeof(H) ||
+           (bytes > 0 && pwrite(fd, &empty[0], bytes, sizeof(H))
+                         != (ssize_t)bytes) ){
+         perror(name.c_str());
+         close(fd);
+         return NULL;
+      }
+
+      ti_writer* w = new ti_writer;
+      w->idx_fd = fd;
+      w->hdr = H;
+      w->base = base;
+
+      return w;
+
+   } // End ti_open_write
+
+
+   int ti_open_part(const ti_writer* w, uint32_t k, ti_part* p){
+
+      std::string name = ti_part_name(w->base, k);
+      p->fp = fopen(name.c_str(), "wb");
+      p->k = k;
+      p->start = 0;
+      p->buf.fp = p->fp;
+      p->buf.n = 0;
+      p->buf.failed = 0;
+
+      if ( p->fp == NULL ){
+         perror(name.c_str());
+         return 1;
+      }
+
+      return 0;
+
+   } // End ti_open_part
+
+
+// A trial is written to 'p' between these two, through an ostream on
+// &p->buf. ti_end_trial flushes the part, then indexes the trial.
+// Different threads may call them at once for different parts and
+// trials.
+   void ti_begin_trial(ti_part* p){
+      p->start = p->buf.n;
+   }
+
+   int ti_end_trial(ti_writer* w, ti_part* p, uint64_t trial){
+
+      if ( trial < w->hdr.first_trial ||
+           trial >= w->hdr.first_trial + w->hdr.n_trials ){ return 1; }
+
+      uint64_t length = p->buf.n - p->start;
+      if ( p->buf.failed != 0 || fflush(p->fp) != 0 ||
+           length > 0xFFFFFFFFULL ){
+         return 1;
+      }
+
+      ti_record r;
+      r.part = p->k;
+      r.length = length;
+      r.offset = p->start;
+
+      off_t at = sizeof(ti_header) +
+                 (trial - w->hdr.first_trial) * sizeof(ti_record);
+
+      return pwrite(w->idx_fd, &r, sizeof(r), at) == (ssize_t)sizeof(r) ?
+             0 : 1;
+
+   } // End ti_end_trial
+
+
+   int ti_close_part(ti_part* p){
+      int status = fclose(p->fp) == 0 ? 0 : 1;
+      p->fp = NULL;
+      return status;
+   }
+
+   int ti_close_write(ti_writer* w){
+      int status = close(w->idx_fd) == 0 ? 0 : 1;
+      delete w;
+      return status;
+   }
+
+
+// --------------------------------------------------------------------
+// Reader
+// --------------------------------------------------------------------
+
+   struct ti_reader {
+      ti_header hdr;
+      std::vector<ti_record> index;
+      std::vector<int> part_fd;
+      uint64_t next;              // for ti_next, relative to first_trial
+   };
+
+
+   void ti_close_read(ti_reader* r){
+      if ( r == NULL ){ return; }
+      for (size_t k=0; k < r->part_fd.size(); k++){
+         if ( r->part_fd[k] >= 0 ){ close(r->part_fd[k]); }
+      }
+      delete r;
+   }
+
+   ti_reader* ti_open_read(const std::string& base){
+
+      std::string name = ti_index_name(base);
+      FILE* fp = fopen(name.c_str(), "rb");
+      if ( fp == NULL ){
+         perror(name.c_str());
+         return NULL;
+      }
+
+      ti_reader* r = new ti_reader;
+      r->next = 0;
+
+      if ( fread(&r->hdr, sizeof(r->hdr), 1, fp) != 1 ||
+           r->hdr.magic != TI_MAGIC || r->hdr.version != TI_VERSION ){
+         printf("%s is not a trial index\n", name.c_str());
+         fclose(fp);
+         delete r;
+         return NULL;
+      }
+
+      r->index.resize(r->hdr.n_trials);
+      if ( r->hdr.n_trials > 0 &&
+           fread(&r->index[0], sizeof(ti_record), r->hdr.n_trials, fp)
+              != r->hdr.n_trials ){
+         printf("%s is truncated\n", name.c_str());
+         fclose(fp);
+         delete r;
+         return NULL;
+      }
+      fclose(fp);
+
+      for (uint32_t k=0; k < r->hdr.n_parts; k++){
+         std::string part = ti_part_name(base, k);
+         r->part_fd.push_back(open(part.c_str(), O_RDONLY));
+      }
+
+      return r;
+
+   } // End ti_open_read
+
+
+// Text of one trial. Returns 0 on success, 1 if the trial is not in
+// the index or could not be read.
+   int ti_read_trial(const ti_reader* r, uint64_t trial, std::string* text){
+
+      if ( trial < r->hdr.first_trial ||
+           trial >= r->hdr.first_trial + r->hdr.n_trials ){ return 1; }
+
+      const ti_record& rec = r->index[trial - r->hdr.first_trial];
+      if ( rec.part >= r->part_fd.size() || r->part_fd[rec.part] < 0 ){
+         return 1;
+      }
+
+      text->resize(rec.length);
+      if ( rec.length > 0 &&
+           pread(r->part_fd[rec.part], &(*text)[0], rec.length, rec.offset)
+              != (ssize_t)rec.length ){
+         return 1;
+      }
+
+      return 0;
+
+   } // End ti_read_trial
+
+
+// Iterates the trials in order. Returns 1 with the next trial, 0 at
+// the end, -1 if a trial is missing or unreadable.
+   int ti_next(ti_reader* r, uint64_t* trial, std::string* text){
+
+      if ( r->next >= r->hdr.n_trials ){ return 0; }
+
+      *trial = r->hdr.first_trial + r->next++;
+
+      return ti_read_trial(r, *trial, text) == 0 ? 1 : -1;
+
+   } // End ti_next
@@ -11,13 +11,17 @@
 //             qc, liquid water mixing ratio
 //             rh_i, initial relative humidity
 //             f, string, filename
+//             buoy, buoyancy, only written when given (--sounding)
 // 
 // Returns: void
 //
-// ver. 1.0
+// ver. 1.2
 // 
 // -- Change log --
 // April 27, 2015 - Initial Release
+// October 19, 2026 - Header and row formatting split out so the
+//                    streaming writer produces the same file.
+// October 19, 2026 - Optional buoyancy column for runs with a sounding
 //
 // -- Licence --
 // Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
@@ -29,15 +33,38 @@
 //
 // --------------------------------------------------------------------
    
+// The column layout of the results file, shared by every writer.
+   void write_output_header(std::ostream& out, int with_buoy = 0){
+      out << "# P_MB, T, TH, QV, QC" << (with_buoy ? ", B" : "") 
+          << std::endl;
+   }
+
+   void write_output_row(std::ostream& out, double p_mb, double T_K,
+                         double theta_K, double qv, double qc,
+                         const double* buoy = NULL){
+
+      char delim = ',';
+      
+      out << p_mb << delim
+          << T_K << delim
+          << theta_K << delim
+          << qv << delim
+          << qc;
+          
+      if ( buoy != NULL ){ out << delim << *buoy; }
+      
+      out << std::endl;
+          
+   } // End write_output_row
+
+
    void write_output_csv(double p_mb[], double theta_K[], double T_K[],
                          double qv[], double qc[], double rh[],
                          int n_steps, int append_flag, 
-                         const std::string& f){
+                         const std::string& f, double buoy[] = NULL){
 
    using namespace std;
    
-   char delim = ',';
-   
    ofstream results_file; // Define and open the text file for use.
    
 // Decide if we need to open the file in append mode
@@ -50,7 +77,7 @@
       results_file.open(f, ios::out);
    
       if (results_file.is_open()) {
-         results_file << "# P_MB, T, TH, QV, QC" << endl;
+         write_output_header(results_file, buoy != NULL);
       }else{
          cout << "File I/O Error! Check Output file.";
       } // End IF, file IO check
@@ -69,11 +96,8 @@
 
       if (results_file.is_open()) {
       
-      results_file << p_mb[i] << delim
-                   << T_K[i] << delim
-                   << theta_K[i] << delim
-                   << qv[i] << delim
-                   << qc[i] << endl;
+      write_output_row(results_file, p_mb[i], T_K[i], theta_K[i],
+                       qv[i], qc[i], buoy != NULL ? &buoy[i] : NULL);
                    
       }else{
          cout << "File I/O Error! Check Output file.";
@@ -0,0 +1,82 @@
+// 
+// write_sensitivity.cpp
+// Write a dual number profile to a CSV file. Each variable is followed
+// by its derivatives with respect to the seeded inputs, in the order
+// TC, QV, PMB (see dual_number.cpp).
+//
+// REQUIRES THE C++11 LIBRARIES
+// 
+// Requires:   AB, profile computed with 'dual' inputs
+//             f, string, filename
+// 
+// Returns: void
+//
+// Derivatives follow each level of the grid, so d/dPMB moves the
+// level along with the starting pressure. Units are those of the
+// variable (K, g/kg) per unit of the input (C, kg/kg, mb).
+//
+// ver. 1.0
+// 
+// -- Change log --
+// October 19, 2026 - Initial Release
+//
+// -- Licence --
+// Two Dimensinal Parcel Model with Variability by Adam C. Abernathy
+// and Jeffery Fitzgerald is licensed under a Creative Commons 
+// Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You can read the full licence and get the most recent code at
+// https://github.com/whokilledkermit/parcel_model
+//
+// --------------------------------------------------------------------
+   
+   void write_sensitivity_csv(const packaged_computations_t<dual>& AB,
+                              const std::string& f){
+
+   using namespace std;
+   
+   char delim = ',';
+   
+   const char* names[] = { "T", "TH", "QV", "QC" };
+   const char* inputs[DUAL_N] = { "TC", "QV", "PMB" };
+   
+   ofstream results_file(f, ios::out);
+   
+   if ( !results_file.is_open() ){
+      cout << "File I/O Error! Check Output file.";
+      return;
+   }
+
+// Header, each variable then its partials
+   results_file << "# P_MB";
+   for (int v=0; v < 4; v++){
+      results_file << ", " << names[v];
+      for (int k=0; k < DUAL_N; k++){
+         results_file << ", d" << names[v] << "_d" << inputs[k];
+      }
+   }
+   results_file << endl;
+   
+   for (int i=0; i <= AB.n_steps -1; i++){
+
+      const dual* cols[] = { &AB.T_K[i], &AB.theta_K[i], 
+                             &AB.qv_gkg[i], &AB.qc_gkg[i] };
+   
+      results_file << AB.p_mb[i].v;
+      
+      for (int v=0; v < 4; v++){
+         results_file << delim << cols[v]->v;
+         for (int k=0; k < DUAL_N; k++){
+            results_file << delim << cols[v]->d[k];
+         }
+      }
+      
+      results_file << endl;
+   
+   } // End for, [i]
+
+   results_file.close(); // Close the text file
+      
+   return;
+   
+   } // All done!